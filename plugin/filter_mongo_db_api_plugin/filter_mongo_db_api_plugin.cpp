@@ -0,0 +1,42 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/filter_mongo_db_api_plugin/filter_mongo_db_api_plugin.hpp>
+
+#include <fc/io/json.hpp>
+
+namespace eosio {
+
+static appbase::abstract_plugin& _filter_mongo_db_api_plugin = app().register_plugin<filter_mongo_db_api_plugin>();
+
+using namespace eosio;
+
+#define CALL(api_name, api_handle, call_name, INVOKE, http_response_code) \
+{std::string("/v1/" #api_name "/" #call_name), \
+   [api_handle](string, string body, url_response_callback cb) mutable { \
+          try { \
+             if (body.empty()) body = "{}"; \
+             INVOKE \
+             cb(http_response_code, fc::json::to_string(result)); \
+          } catch (...) { \
+             http_plugin::handle_exception(#api_name, #call_name, body, cb); \
+          } \
+       }}
+
+#define INVOKE_R_V(api_handle, call_name) \
+     auto result = api_handle->call_name();
+
+void filter_mongo_db_api_plugin::plugin_startup() {
+   ilog( "starting filter_mongo_db_api_plugin" );
+   auto* filter_plug = &app().get_plugin<filter_mongo_db_plugin>();
+
+   app().get_plugin<http_plugin>().add_api({
+       CALL(filter_mongo_db, filter_plug, get_metrics, INVOKE_R_V(filter_plug, get_metrics), 200),
+   });
+}
+
+#undef INVOKE_R_V
+#undef CALL
+
+}
@@ -0,0 +1,36 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/filter_mongo_db_plugin.hpp>
+#include <eosio/http_plugin/http_plugin.hpp>
+
+#include <appbase/application.hpp>
+
+namespace eosio {
+
+using namespace appbase;
+
+/**
+ * Serves the pipeline metrics of filter_mongo_db_plugin at /v1/filter_mongo_db/get_metrics.
+ */
+class filter_mongo_db_api_plugin : public plugin<filter_mongo_db_api_plugin> {
+public:
+   APPBASE_PLUGIN_REQUIRES((filter_mongo_db_plugin)(http_plugin))
+
+   filter_mongo_db_api_plugin() = default;
+   filter_mongo_db_api_plugin(const filter_mongo_db_api_plugin&) = delete;
+   filter_mongo_db_api_plugin(filter_mongo_db_api_plugin&&) = delete;
+   filter_mongo_db_api_plugin& operator=(const filter_mongo_db_api_plugin&) = delete;
+   filter_mongo_db_api_plugin& operator=(filter_mongo_db_api_plugin&&) = delete;
+   virtual ~filter_mongo_db_api_plugin() override = default;
+
+   virtual void set_program_options(options_description& cli, options_description& cfg) override {}
+   void plugin_initialize(const variables_map& vm) {}
+   void plugin_startup();
+   void plugin_shutdown() {}
+};
+
+}
@@ -0,0 +1,124 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/filter_mongo_db_plugin/account_registry.hpp>
+#include <eosio/filter_mongo_db_plugin/bson_convert.hpp>
+#include <eosio/filter_mongo_db_plugin/write_errors.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/optional.hpp>
+
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/types.hpp>
+
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/exception/bulk_write_exception.hpp>
+#include <mongocxx/model/update_one.hpp>
+
+#include <chrono>
+
+namespace eosio {
+
+namespace {
+
+   bsoncxx::types::b_date to_date( fc::time_point t ) {
+      return bsoncxx::types::b_date{ std::chrono::milliseconds{ t.time_since_epoch().count() / 1000 }};
+   }
+
+}
+
+account_registry::abi_ptr account_registry::abi( const account_name& n )const {
+   auto itr = abis.find( n.value );
+   return itr != abis.end() ? itr->second : abi_ptr();
+}
+
+void account_registry::load( const account_name& n, abi_ptr abi ) {
+   auto itr = abis.find( n.value );
+   if( itr != abis.end() )
+      itr->second = std::move( abi );
+}
+
+account_registry::change& account_registry::change_of( const account_name& n, fc::time_point at ) {
+   auto itr = changes.find( n.value );
+   if( itr == changes.end() ) {
+      itr = changes.emplace( n.value, change() ).first;
+      itr->second.created_at = at;
+   }
+   itr->second.updated_at = at;
+   return itr->second;
+}
+
+void account_registry::created( const account_name& n, fc::time_point at ) {
+   if( write_back )
+      change_of( n, at );
+}
+
+void account_registry::set_abi( const account_name& n, abi_ptr abi, fc::time_point at ) {
+   if( write_back ) {
+      auto& c = change_of( n, at );
+      c.abi_set = true;
+      c.abi = abi;
+   }
+   auto itr = abis.find( n.value );
+   if( itr != abis.end() )
+      itr->second = std::move( abi );
+}
+
+bool account_registry::flush( mongocxx::collection& accounts ) {
+   using bsoncxx::builder::basic::kvp;
+   using bsoncxx::builder::basic::make_document;
+
+   if( changes.empty() )
+      return true;
+
+   mongocxx::options::bulk_write bulk_opts;
+   bulk_opts.ordered(false);
+   mongocxx::bulk_write bulk = accounts.create_bulk_write(bulk_opts);
+   for( const auto& c : changes ) {
+      const account_name n( c.first );
+      bsoncxx::builder::basic::document update;
+      update.append( kvp( "$setOnInsert", make_document( kvp( "createdAt", to_date( c.second.created_at )))));
+      if( c.second.abi_set ) {
+         fc::optional<bsoncxx::document::value> abi;
+         try {
+            if( c.second.abi )
+               abi.emplace( to_bson( *c.second.abi ));
+         } catch( fc::exception& e ) {
+            ilog( "Unable to convert abi_def of ${n} to BSON: ${e}", ("n", n)("e", e.to_string()));
+         }
+         if( abi ) {
+            update.append( kvp( "$set", make_document( kvp( "abi", *abi ), kvp( "updatedAt", to_date( c.second.updated_at )))));
+         } else {
+            update.append( kvp( "$set", make_document( kvp( "updatedAt", to_date( c.second.updated_at )))),
+                           kvp( "$unset", make_document( kvp( "abi", "" ))));
+         }
+      }
+      mongocxx::model::update_one upsert{ make_document( kvp( "name", n.to_string())), update.extract() };
+      upsert.upsert( true );
+      bulk.append( upsert );
+   }
+
+   try {
+      if( !bulk.execute() ) {
+         elog( "Bulk account upsert failed for ${n} accounts", ("n", changes.size()));
+      }
+   } catch( mongocxx::bulk_write_exception& e ) {
+      if( !rejected_documents( e )) {
+         elog( "Bulk account upsert of ${n} accounts failed, retrying: ${e}", ("n", changes.size())("e", e.what()));
+         return false;
+      }
+      elog( "Bulk account upsert of ${n} accounts failed: ${e}", ("n", changes.size())("e", e.what()));
+      changes.clear();
+      return false;
+   } catch( std::exception& e ) {
+      elog( "Bulk account upsert of ${n} accounts failed, retrying: ${e}", ("n", changes.size())("e", e.what()));
+      return false;
+   }
+   changes.clear();
+   return true;
+}
+
+}
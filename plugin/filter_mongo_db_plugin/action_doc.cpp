@@ -0,0 +1,131 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/filter_mongo_db_plugin/action_doc.hpp>
+#include <eosio/filter_mongo_db_plugin/bson_convert.hpp>
+
+#include <eosio/chain/config.hpp>
+#include <eosio/chain/contract_types.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/types.hpp>
+
+namespace eosio {
+
+namespace {
+
+   const chain::action_name newaccount = N(newaccount);
+   const chain::action_name setabi = N(setabi);
+
+   /// returns false when the data could not be decoded
+   bool decode_data( const chain::action& act, const action_doc_builder::serializer_ptr& abis, fc::variant& data ) {
+      try {
+         if( act.account == chain::config::system_account_name ) {
+            if( act.name == newaccount ) {
+               fc::to_variant( act.data_as<chain::newaccount>(), data );
+               return true;
+            } else if( act.name == setabi ) {
+               auto setabi = act.data_as<chain::setabi>();
+               try {
+                  data = fc::mutable_variant_object()
+                        ( "account", setabi.account.to_string() )
+                        ( "abi_def", fc::raw::unpack<chain::abi_def>( setabi.abi ));
+                  return true;
+               } catch( fc::exception& e ) {
+                  ilog( "Unable to convert action abi_def to json for ${n}", ( "n", setabi.account.to_string() ));
+               }
+            }
+         }
+         if( abis ) {
+            data = abis->binary_to_variant( abis->get_action_type( act.name ), act.data );
+            return true;
+         }
+      } catch (fc::exception& e) {
+         if( act.name != "onblock" ) { // onblock not in original eosio.system contract abi
+            dlog( "Unable to convert action.data to ABI: ${s}::${n}, what: ${e}",
+                  ("s", act.account)( "n", act.name )( "e", e.to_detail_string()));
+         }
+      } catch (std::exception& e) {
+         ilog( "Unable to convert action.data to ABI: ${s}::${n}, std what: ${e}",
+               ("s", act.account)( "n", act.name )( "e", e.what()));
+      } catch (...) {
+         ilog( "Unable to convert action.data to ABI: ${s}::${n}, unknown exception",
+               ("s", act.account)( "n", act.name ));
+      }
+      return false;
+   }
+
+}
+
+bsoncxx::stdx::string_view name_cache::get( uint64_t value ) {
+   auto itr = strings.find( value );
+   if( itr == strings.end() ) {
+      if( strings.size() >= max_size )
+         strings.clear();
+      itr = strings.emplace( value, chain::name( value ).to_string() ).first;
+   }
+   return bsoncxx::stdx::string_view( itr->second.data(), itr->second.size() );
+}
+
+void action_doc_builder::append_header( const chain::action& act, int32_t action_num, bsoncxx::stdx::string_view trx_id,
+                                        const chain::action_receipt* receipt ) {
+   using namespace bsoncxx::types;
+   using bsoncxx::builder::basic::kvp;
+
+   doc.append( kvp( "action_num", b_int32{action_num} ),
+               kvp( "trx_id", trx_id ));
+   doc.append( kvp( "cfa", b_bool{false} ));
+   doc.append( kvp( "account", names.get( act.account.value )));
+   doc.append( kvp( "name", names.get( act.name.value )));
+   doc.append( kvp( "authorization", [&]( bsoncxx::builder::basic::sub_array subarr ) {
+      for( const auto& auth : act.authorization ) {
+         subarr.append( [&]( bsoncxx::builder::basic::sub_document subdoc ) {
+            subdoc.append( kvp( "actor", names.get( auth.actor.value )));
+            subdoc.append( kvp( "permission", names.get( auth.permission.value )));
+         } );
+      }
+   } ));
+   if( receipt ) {
+      doc.append( kvp( "receiver", names.get( receipt->receiver.value )));
+      doc.append( kvp( "global_sequence", b_int64{ static_cast<int64_t>( receipt->global_sequence ) } ));
+   }
+}
+
+void action_doc_builder::build( const chain::action& act, int32_t action_num, bsoncxx::stdx::string_view trx_id,
+                                const serializer_ptr& abis, raw_data_mode raw_data, doc_buffer& out,
+                                const chain::action_receipt* receipt ) {
+   using bsoncxx::builder::basic::kvp;
+
+   fc::variant data;
+   bool decoded = raw_data != raw_data_mode::only && decode_data( act, abis, data );
+
+   doc.clear();
+   append_header( act, action_num, trx_id, receipt );
+   if( decoded ) {
+      try {
+         // straight into the reused buffer, without a document of its own
+         append_variant( doc, "data", data );
+      } catch( fc::exception& e ) {
+         elog( "Unable to convert EOS variant to MongoDB BSON: ${e}", ("e", e.to_string()));
+         elog( "  EOS JSON: ${j}", ("j", fc::json::to_string( data )));
+         // the data may be half written, start over without it
+         decoded = false;
+         doc.clear();
+         append_header( act, action_num, trx_id, receipt );
+      }
+   }
+   // if anything went wrong just store the raw data, copied straight from the action and half the size of hex text
+   if( !decoded || raw_data == raw_data_mode::always ) {
+      doc.append( kvp( "raw_data", bsoncxx::types::b_binary{ bsoncxx::binary_sub_type::k_binary, static_cast<uint32_t>( act.data.size() ),
+                                                             reinterpret_cast<const uint8_t*>( act.data.data() ) } ));
+   }
+   out.append( doc.view() );
+   doc.clear();
+}
+
+}
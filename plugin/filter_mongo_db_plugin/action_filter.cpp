@@ -0,0 +1,76 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/filter_mongo_db_plugin/action_filter.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <boost/algorithm/string.hpp>
+
+namespace eosio {
+
+namespace {
+
+   account_name rule_name( const std::string& s, const std::string& rule ) {
+      FC_ASSERT( !s.empty() && s.size() <= 13, "Invalid name '${n}' in filter-contract rule '${r}'", ("n", s)("r", rule) );
+      account_name n( s );
+      FC_ASSERT( n.to_string() == s, "Invalid name '${n}' in filter-contract rule '${r}'", ("n", s)("r", rule) );
+      return n;
+   }
+
+}
+
+void action_filter::add_rule( const std::string& rule ) {
+   std::vector<std::string> parts;
+   boost::split( parts, rule, boost::is_any_of( ":" ));
+   FC_ASSERT( parts.size() <= 3, "Invalid filter-contract rule '${r}', expected contract[:action[:actor]]", ("r", rule) );
+
+   const auto contract = rule_name( parts[0], rule );
+   auto itr = contracts.find( contract.value );
+   if( itr == contracts.end() ) {
+      itr = contracts.emplace( contract.value, contract_rule() ).first;
+      itr->second.index = names.size();
+      names.push_back( contract );
+   }
+   auto& c = itr->second;
+   if( parts.size() == 1 ) {
+      c.any_action = true;
+      return;
+   }
+
+   auto& a = c.actions[rule_name( parts[1], rule ).value];
+   if( parts.size() == 2 ) {
+      a.any_actor = true;
+      return;
+   }
+
+   a.actors.insert( rule_name( parts[2], rule ).value );
+}
+
+size_t action_filter::contract_index( const account_name& contract )const {
+   auto c = contracts.find( contract.value );
+   return c == contracts.end() ? names.size() : c->second.index;
+}
+
+bool action_filter::match( const account_name& contract, const chain::action& act )const {
+   auto c = contracts.find( contract.value );
+   if( c == contracts.end() )
+      return false;
+   if( c->second.any_action )
+      return true;
+
+   auto a = c->second.actions.find( act.name.value );
+   if( a == c->second.actions.end() )
+      return false;
+   if( a->second.any_actor )
+      return true;
+
+   for( const auto& auth : act.authorization ) {
+      if( a->second.actors.count( auth.actor.value ))
+         return true;
+   }
+   return false;
+}
+
+}
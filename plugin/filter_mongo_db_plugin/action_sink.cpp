@@ -0,0 +1,302 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/filter_mongo_db_plugin/action_sink.hpp>
+#include <eosio/filter_mongo_db_plugin/write_errors.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+
+#include <mongocxx/client.hpp>
+#include <mongocxx/exception/bulk_write_exception.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace eosio {
+
+namespace {
+
+   class mongo_sink : public action_sink {
+   public:
+      mongo_sink( mongocxx::pool& pool, const std::string& db_name, const std::string& collection,
+                  const mongocxx::write_concern& relaxed_concern, bool upsert, uint32_t upsert_until_block )
+      : client( pool.acquire() )
+      , coll( (*client)[db_name][collection] )
+      , relaxed_concern( relaxed_concern )
+      , upsert( upsert )
+      , upsert_until_block( upsert_until_block ) {}
+
+      write_result write( const doc_buffer& docs, bool relaxed ) override {
+         mongocxx::options::bulk_write bulk_opts;
+         bulk_opts.ordered(false);
+         if( relaxed ) {
+            bulk_opts.write_concern( relaxed_concern );
+         }
+         mongocxx::bulk_write bulk_filter = coll.create_bulk_write(bulk_opts);
+
+         // the bulk write copies the documents straight from the views into its command
+         docs.for_each( [&]( const bsoncxx::document::view& view ) {
+            if( upsert || ( upsert_until_block > 0 && block_num_of( view ) <= upsert_until_block )) {
+               using bsoncxx::builder::basic::make_document;
+               using bsoncxx::builder::basic::kvp;
+               mongocxx::model::replace_one replace{ make_document( kvp( "trx_id", view["trx_id"].get_value() ),
+                                                                    kvp( "action_num", view["action_num"].get_value() )),
+                                                     view };
+               replace.upsert( true );
+               bulk_filter.append( replace );
+            } else {
+               bulk_filter.append( mongocxx::model::insert_one{view} );
+            }
+         } );
+
+         try {
+            // an unacknowledged write has no result
+            if( !bulk_filter.execute() && !( relaxed && !relaxed_concern.is_acknowledged() )) {
+               elog( "Bulk filter insert failed for ${n} actions", ("n", docs.size()));
+            }
+         } catch( mongocxx::bulk_write_exception& e ) {
+            if( rejected_documents( e )) {
+               elog( "Bulk filter insert of ${n} actions failed: ${e}", ("n", docs.size())("e", e.what()));
+               return write_result::rejected;
+            }
+            elog( "Bulk filter insert of ${n} actions failed, retrying: ${e}", ("n", docs.size())("e", e.what()));
+            return write_result::retry;
+         } catch( std::exception& e ) {
+            elog( "Bulk filter insert of ${n} actions failed, retrying: ${e}", ("n", docs.size())("e", e.what()));
+            return write_result::retry;
+         }
+         return write_result::written;
+      }
+
+      void sync() override {
+         using bsoncxx::builder::basic::make_document;
+         using bsoncxx::builder::basic::kvp;
+         // on the connection of the writes, so unacknowledged writes are applied before it
+         (*client)["admin"].run_command( make_document( kvp( "fsync", 1 )));
+      }
+
+   private:
+      mongocxx::pool::entry   client;
+      mongocxx::collection    coll;
+      mongocxx::write_concern relaxed_concern;
+      bool                    upsert;
+      uint32_t                upsert_until_block;
+
+      static uint32_t block_num_of( const bsoncxx::document::view& doc ) {
+         const auto n = doc["block_num"];
+         return n && n.type() == bsoncxx::type::k_int32 ? static_cast<uint32_t>( n.get_int32().value ) : 0;
+      }
+   };
+
+   class file_sink : public action_sink {
+   public:
+      file_sink( const boost::filesystem::path& dir, uint64_t segment_size, boost::chrono::seconds segment_age );
+      ~file_sink();
+
+      write_result write( const doc_buffer& docs, bool relaxed ) override;
+      void sync() override;
+
+   private:
+      boost::filesystem::path segment_path( uint64_t seq, bool part )const;
+      void open_segment();
+      void close_segment();
+      static void recover( const boost::filesystem::path& part, const boost::filesystem::path& complete );
+
+      boost::filesystem::path                  dir;
+      uint64_t                                 segment_size;
+      boost::chrono::seconds                   segment_age;
+      int                                      fd = -1;
+      uint64_t                                 seq = 0;
+      uint64_t                                 size = 0;
+      boost::chrono::steady_clock::time_point  opened_at;
+   };
+
+   class null_sink : public action_sink {
+   public:
+      write_result write( const doc_buffer&, bool ) override { return write_result::written; }
+      void sync() override {}
+   };
+
+   const size_t segment_name_size = 29; // actions-<16 hex digits>.bson
+
+   bool parse_segment_name( const std::string& name, uint64_t& seq, bool& part ) {
+      part = name.size() == segment_name_size + 5 && name.compare( segment_name_size, 5, ".part" ) == 0;
+      if( ( name.size() != segment_name_size && !part ) || name.compare( 0, 8, "actions-" ) != 0 || name.compare( 24, 5, ".bson" ) != 0 )
+         return false;
+      const auto hex = name.substr( 8, 16 );
+      if( hex.find_first_not_of( "0123456789abcdef" ) != std::string::npos )
+         return false;
+      seq = std::stoull( hex, nullptr, 16 );
+      return true;
+   }
+
+   file_sink::file_sink( const boost::filesystem::path& dir, uint64_t segment_size, boost::chrono::seconds segment_age )
+   : dir( dir )
+   , segment_size( std::max<uint64_t>( segment_size, 1 << 16 ))
+   , segment_age( segment_age )
+   {
+      boost::filesystem::create_directories( dir );
+
+      bool found = false;
+      std::vector<uint64_t> parts;
+      for( boost::filesystem::directory_iterator it( dir ), end; it != end; ++it ) {
+         uint64_t s;
+         bool part;
+         if( !parse_segment_name( it->path().filename().string(), s, part ))
+            continue;
+         if( part )
+            parts.push_back( s );
+         seq = std::max( seq, s );
+         found = true;
+      }
+      for( auto s : parts ) {
+         recover( segment_path( s, true ), segment_path( s, false ));
+      }
+      if( found )
+         ++seq;
+   }
+
+   file_sink::~file_sink() {
+      try {
+         close_segment();
+      } catch( fc::exception& e ) {
+         elog( "Unable to close action segment: ${e}", ("e", e.to_string()));
+      } catch( std::exception& e ) {
+         elog( "Unable to close action segment: ${e}", ("e", e.what()));
+      }
+   }
+
+   boost::filesystem::path file_sink::segment_path( uint64_t s, bool part )const {
+      char name[40];
+      std::snprintf( name, sizeof(name), "actions-%016llx.bson%s", static_cast<unsigned long long>( s ), part ? ".part" : "" );
+      return dir / name;
+   }
+
+   void file_sink::recover( const boost::filesystem::path& part, const boost::filesystem::path& complete ) {
+      uint64_t valid = 0;
+      {
+         std::ifstream in( part.string(), std::ios::binary );
+         const uint64_t file_size = boost::filesystem::file_size( part );
+         int32_t length;
+         while( in.read( reinterpret_cast<char*>( &length ), sizeof(length) ) && length >= 5 && valid + length <= file_size ) {
+            valid += length;
+            in.seekg( valid );
+         }
+      }
+      if( valid == 0 ) {
+         boost::filesystem::remove( part );
+         return;
+      }
+      if( valid < boost::filesystem::file_size( part )) {
+         wlog( "cutting torn action segment ${f} back to ${n} bytes", ("f", part.string())("n", valid) );
+         boost::filesystem::resize_file( part, valid );
+      }
+      boost::filesystem::rename( part, complete );
+   }
+
+   void file_sink::open_segment() {
+      // left behind by a segment that could not be closed
+      if( boost::filesystem::exists( segment_path( seq, true ))) {
+         recover( segment_path( seq, true ), segment_path( seq, false ));
+         ++seq;
+      }
+      const auto path = segment_path( seq, true );
+      fd = ::open( path.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+      FC_ASSERT( fd >= 0, "Unable to create action segment ${f}: ${e}", ("f", path.string())("e", std::strerror( errno )) );
+      size = 0;
+      opened_at = boost::chrono::steady_clock::now();
+   }
+
+   void file_sink::close_segment() {
+      if( fd < 0 )
+         return;
+      FC_ASSERT( ::fsync( fd ) == 0, "Unable to sync action segment ${f}: ${e}",
+                 ("f", segment_path( seq, true ).string())("e", std::strerror( errno )) );
+      ::close( fd );
+      fd = -1;
+      if( size == 0 ) {
+         boost::filesystem::remove( segment_path( seq, true ));
+         return;
+      }
+      boost::filesystem::rename( segment_path( seq, true ), segment_path( seq, false ));
+      ++seq;
+   }
+
+   void file_sink::sync() {
+      if( fd >= 0 ) {
+         FC_ASSERT( ::fsync( fd ) == 0, "Unable to sync action segment ${f}: ${e}",
+                    ("f", segment_path( seq, true ).string())("e", std::strerror( errno )) );
+      }
+   }
+
+   action_sink::write_result file_sink::write( const doc_buffer& docs, bool ) {
+      try {
+         if( fd >= 0 && ( size >= segment_size ||
+                          ( segment_age.count() > 0 && boost::chrono::steady_clock::now() - opened_at >= segment_age ))) {
+            close_segment();
+         }
+         if( fd < 0 ) {
+            open_segment();
+         }
+
+         // the buffer already holds the documents back to back as in the segment
+         const auto* data = docs.data();
+         size_t done = 0;
+         while( done < docs.byte_size() ) {
+            const ssize_t n = ::pwrite( fd, data + done, docs.byte_size() - done, size + done );
+            if( n < 0 && errno == EINTR )
+               continue;
+            if( n <= 0 ) {
+               elog( "Unable to write ${n} actions to ${f}, retrying: ${e}",
+                     ("n", docs.size())("f", segment_path( seq, true ).string())("e", std::strerror( errno )) );
+               // keep the segment ending on a complete document
+               if( ::ftruncate( fd, size ) != 0 ) {
+                  ::close( fd );
+                  fd = -1;
+               }
+               return write_result::retry;
+            }
+            done += n;
+         }
+         size += docs.byte_size();
+      } catch( fc::exception& e ) {
+         elog( "Unable to write ${n} actions, retrying: ${e}", ("n", docs.size())("e", e.to_string()));
+         return write_result::retry;
+      } catch( std::exception& e ) {
+         elog( "Unable to write ${n} actions, retrying: ${e}", ("n", docs.size())("e", e.what()));
+         return write_result::retry;
+      }
+      return write_result::written;
+   }
+
+}
+
+std::unique_ptr<action_sink> make_mongo_sink( mongocxx::pool& pool, const std::string& db_name, const std::string& collection,
+                                              const mongocxx::write_concern& relaxed_concern, bool upsert,
+                                              uint32_t upsert_until_block ) {
+   return std::unique_ptr<action_sink>( new mongo_sink( pool, db_name, collection, relaxed_concern, upsert, upsert_until_block ));
+}
+
+std::unique_ptr<action_sink> make_file_sink( const boost::filesystem::path& dir, uint64_t segment_size,
+                                             boost::chrono::seconds segment_age ) {
+   return std::unique_ptr<action_sink>( new file_sink( dir, segment_size, segment_age ));
+}
+
+std::unique_ptr<action_sink> make_null_sink() {
+   return std::unique_ptr<action_sink>( new null_sink );
+}
+
+}
@@ -0,0 +1,197 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/filter_mongo_db_plugin/action_stats.hpp>
+#include <eosio/filter_mongo_db_plugin/write_errors.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/builder/concatenate.hpp>
+#include <bsoncxx/types.hpp>
+
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/exception/bulk_write_exception.hpp>
+#include <mongocxx/model/update_one.hpp>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace eosio {
+
+namespace {
+
+   std::string utf8_of( const bsoncxx::document::element& e ) {
+      if( !e || e.type() != bsoncxx::type::k_utf8 )
+         return std::string();
+      const auto v = e.get_utf8().value;
+      return std::string( v.data(), v.size() );
+   }
+
+   uint32_t block_num_of( const bsoncxx::document::element& e ) {
+      if( !e || e.type() != bsoncxx::type::k_int32 )
+         return 0;
+      return static_cast<uint32_t>( e.get_int32().value );
+   }
+
+}
+
+uint32_t action_stats::parse_dimensions( const std::string& list ) {
+   std::vector<std::string> names;
+   boost::split( names, list, boost::is_any_of( "," ));
+   uint32_t result = 0;
+   for( auto n : names ) {
+      boost::trim( n );
+      if( n == "account" )
+         result |= account;
+      else if( n == "name" )
+         result |= name;
+      else if( n == "actor" )
+         result |= actor;
+      else
+         FC_ASSERT( n.empty(), "Invalid stats dimension ${d}, expected account, name or actor", ("d", n) );
+   }
+   return result;
+}
+
+action_stats::action_stats( uint32_t dimensions, uint32_t bucket_sec, bool unique_actors )
+: dimensions( dimensions )
+, bucket_ms( std::max<int64_t>( bucket_sec, 1 ) * 1000 )
+, unique_actors( unique_actors ) {}
+
+void action_stats::add( const bsoncxx::document::view& doc ) {
+   const auto time = doc["block_time"];
+   if( !time || time.type() != bsoncxx::type::k_date )
+      return;
+   const int64_t ms = time.get_date().to_int64();
+   const int64_t bucket = ms - ( ( ms % bucket_ms ) + bucket_ms ) % bucket_ms;
+   const uint32_t block_num = block_num_of( doc["block_num"] );
+   const uint32_t block = block_num <= resume_until ? block_num : all_blocks;
+
+   const std::string acc = ( dimensions & account ) ? utf8_of( doc["account"] ) : std::string();
+   const std::string act = ( dimensions & name ) ? utf8_of( doc["name"] ) : std::string();
+   if( !( dimensions & actor )) {
+      add( key( block, bucket, acc, act, std::string() ), block_num, doc );
+      return;
+   }
+   // an action counts once for every actor authorizing it
+   const auto auths = doc["authorization"];
+   if( !auths || auths.type() != bsoncxx::type::k_array )
+      return;
+   for( const auto& auth : auths.get_array().value ) {
+      if( auth.type() == bsoncxx::type::k_document )
+         add( key( block, bucket, acc, act, utf8_of( auth.get_document().value["actor"] )), block_num, doc );
+   }
+}
+
+void action_stats::add( key&& k, uint32_t block_num, const bsoncxx::document::view& doc ) {
+   auto& c = changes[std::move( k )];
+   if( c.actions == 0 )
+      c.first_block = block_num;
+   c.last_block = block_num;
+   ++c.actions;
+   if( !unique_actors )
+      return;
+   const auto auths = doc["authorization"];
+   if( !auths || auths.type() != bsoncxx::type::k_array )
+      return;
+   for( const auto& auth : auths.get_array().value ) {
+      if( auth.type() == bsoncxx::type::k_document )
+         c.actors.insert( utf8_of( auth.get_document().value["actor"] ));
+   }
+}
+
+bsoncxx::document::value action_stats::index_keys()const {
+   using bsoncxx::builder::basic::kvp;
+   bsoncxx::builder::basic::document keys;
+   keys.append( kvp( "bucket", 1 ));
+   if( dimensions & account )
+      keys.append( kvp( "account", 1 ));
+   if( dimensions & name )
+      keys.append( kvp( "name", 1 ));
+   if( dimensions & actor )
+      keys.append( kvp( "actor", 1 ));
+   return keys.extract();
+}
+
+bool action_stats::flush( mongocxx::collection& stats ) {
+   using namespace bsoncxx::types;
+   using bsoncxx::builder::basic::kvp;
+   using bsoncxx::builder::basic::make_document;
+
+   if( changes.empty() )
+      return true;
+
+   // the changes of a document to resume are in block order, they must be applied in that order
+   mongocxx::options::bulk_write bulk_opts;
+   bulk_opts.ordered(true);
+   mongocxx::bulk_write bulk = stats.create_bulk_write(bulk_opts);
+   for( const auto& c : changes ) {
+      bsoncxx::builder::basic::document keys;
+      keys.append( kvp( "bucket", b_date{ std::chrono::milliseconds{ std::get<1>( c.first ) }} ));
+      if( dimensions & account )
+         keys.append( kvp( "account", std::get<2>( c.first )));
+      if( dimensions & name )
+         keys.append( kvp( "name", std::get<3>( c.first )));
+      if( dimensions & actor )
+         keys.append( kvp( "actor", std::get<4>( c.first )));
+      bsoncxx::builder::basic::array actors;
+      for( const auto& a : c.second.actors ) {
+         actors.append( a );
+      }
+      const b_int64 actions{ static_cast<int64_t>( c.second.actions ) };
+      const b_int32 last_block{ static_cast<int32_t>( c.second.last_block ) };
+
+      // an existing document counts the change unless it counted its first block already
+      bsoncxx::builder::basic::document filter;
+      filter.append( bsoncxx::builder::concatenate( keys.view() ));
+      filter.append( kvp( "block_num", make_document( kvp( "$not", make_document(
+            kvp( "$gte", b_int32{ static_cast<int32_t>( c.second.first_block ) } ))))));
+      bsoncxx::builder::basic::document update;
+      update.append( kvp( "$inc", make_document( kvp( "actions", actions ))),
+                     kvp( "$max", make_document( kvp( "block_num", last_block ))));
+      if( unique_actors ) {
+         update.append( kvp( "$addToSet", make_document( kvp( "actors", make_document( kvp( "$each", actors.view() ))))));
+      }
+      bulk.append( mongocxx::model::update_one{ filter.extract(), update.extract() } );
+
+      // a missing one is created with the change
+      bsoncxx::builder::basic::document fields;
+      fields.append( kvp( "actions", actions ), kvp( "block_num", last_block ));
+      if( unique_actors ) {
+         fields.append( kvp( "actors", actors.view() ));
+      }
+      mongocxx::model::update_one upsert{ keys.extract(), make_document( kvp( "$setOnInsert", fields.extract() )) };
+      upsert.upsert( true );
+      bulk.append( upsert );
+   }
+
+   try {
+      if( !bulk.execute() ) {
+         elog( "Bulk stats upsert failed for ${n} buckets", ("n", changes.size()));
+      }
+   } catch( mongocxx::bulk_write_exception& e ) {
+      // the upserts applied before the failure skip their changes when flushed again
+      if( !rejected_documents( e )) {
+         elog( "Bulk stats upsert of ${n} buckets failed, retrying: ${e}", ("n", changes.size())("e", e.what()));
+         return false;
+      }
+      elog( "Bulk stats upsert of ${n} buckets failed: ${e}", ("n", changes.size())("e", e.what()));
+      changes.clear();
+      return false;
+   } catch( std::exception& e ) {
+      elog( "Bulk stats upsert of ${n} buckets failed, retrying: ${e}", ("n", changes.size())("e", e.what()));
+      return false;
+   }
+   changes.clear();
+   return true;
+}
+
+}
@@ -0,0 +1,43 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <fc/io/json.hpp>
+#include <fc/variant_object.hpp>
+
+#include <chrono>
+#include <iostream>
+
+namespace eosio { namespace bench {
+
+/// keeps results alive so the measured work is not optimized away
+inline void consume( size_t v ) {
+   static volatile size_t sink = 0;
+   sink += v;
+}
+
+/**
+ * Runs f iterations times after a short warm up and prints one JSON object per
+ * case: { "case": ..., "iterations": ..., "ns_per_op": ... } plus extra fields.
+ */
+template<typename F>
+void run_case( const std::string& name, uint64_t iterations, F&& f,
+               fc::mutable_variant_object extra = fc::mutable_variant_object() ) {
+   for( uint64_t i = 0; i < iterations / 10 + 1; ++i ) {
+      consume( f() );
+   }
+   const auto start = std::chrono::steady_clock::now();
+   for( uint64_t i = 0; i < iterations; ++i ) {
+      consume( f() );
+   }
+   const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+
+   extra( "case", name )
+        ( "iterations", iterations )
+        ( "ns_per_op", double( ns ) / double( iterations ? iterations : 1 ));
+   std::cout << fc::json::to_string( extra, fc::json::legacy_generator ) << std::endl;
+}
+
+} }
@@ -0,0 +1,90 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Compares the JSON round trip (fc::json::to_string + bsoncxx::from_json and
+ *  bsoncxx::to_json + fc::json::from_string) with the direct converter in
+ *  bson_convert.hpp on eosio.token and eosio.system payloads.
+ *
+ *  usage: filter_mongo_db_bson_bench [iterations]
+ */
+#include "bench.hpp"
+#include "fixtures.hpp"
+
+#include <eosio/filter_mongo_db_plugin/bson_convert.hpp>
+
+#include <bsoncxx/json.hpp>
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace eosio;
+using namespace eosio::bench;
+
+namespace {
+
+   bsoncxx::document::value json_to_bson( const fc::variant& v ) {
+      return bsoncxx::from_json( fc::json::to_string( v ));
+   }
+
+   void check_same( const std::string& name, const fc::variant& v ) {
+      auto expected = json_to_bson( v );
+      auto actual = to_bson( v );
+      if( expected.view().length() != actual.view().length() ||
+          std::memcmp( expected.view().data(), actual.view().data(), expected.view().length()) != 0 ) {
+         std::cerr << "direct conversion of " << name << " differs from the json round trip:\n"
+                   << bsoncxx::to_json( expected.view()) << "\n" << bsoncxx::to_json( actual.view()) << std::endl;
+         std::exit( 1 );
+      }
+   }
+
+   void variant_to_bson_cases( const std::string& name, const fc::variant& v, uint64_t iterations ) {
+      check_same( name, v );
+      run_case( "variant_to_bson/json/" + name, iterations, [&]() { return json_to_bson( v ).view().length(); } );
+      run_case( "variant_to_bson/direct/" + name, iterations, [&]() { return to_bson( v ).view().length(); } );
+   }
+
+   void bson_to_abi_cases( const std::string& name, const abi_def& abi, uint64_t iterations ) {
+      auto doc = to_bson( abi );
+      auto view = doc.view();
+      run_case( "bson_to_abi/json/" + name, iterations, [&]() {
+         return fc::json::from_string( bsoncxx::to_json( view )).as<abi_def>().structs.size();
+      } );
+      run_case( "bson_to_abi/direct/" + name, iterations, [&]() {
+         return from_bson( view ).as<abi_def>().structs.size();
+      } );
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   const uint64_t iterations = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 100000;
+
+   const auto token_abi = load_abi( token_abi_json );
+   const auto system_abi = load_abi( system_abi_json );
+   abi_serializer token_abis( token_abi );
+   abi_serializer system_abis( system_abi );
+
+   const auto transfer = make_action( token_abis, N(eosio.token), N(transfer), token_transfer_json );
+   const auto newaccount = make_action( system_abis, N(eosio), N(newaccount), system_newaccount_json );
+   const auto voteproducer = make_action( system_abis, N(eosio), N(voteproducer), system_voteproducer_json );
+
+   auto decoded = []( const abi_serializer& abis, const chain::action& act ) {
+      return abis.binary_to_variant( abis.get_action_type( act.name ), act.data );
+   };
+
+   fc::variant token_abi_var, system_abi_var;
+   fc::to_variant( token_abi, token_abi_var );
+   fc::to_variant( system_abi, system_abi_var );
+
+   variant_to_bson_cases( "token_transfer", decoded( token_abis, transfer ), iterations );
+   variant_to_bson_cases( "system_newaccount", decoded( system_abis, newaccount ), iterations );
+   variant_to_bson_cases( "system_voteproducer", decoded( system_abis, voteproducer ), iterations );
+   variant_to_bson_cases( "token_abi", token_abi_var, iterations / 10 );
+   variant_to_bson_cases( "system_abi", system_abi_var, iterations / 10 );
+
+   bson_to_abi_cases( "token_abi", token_abi, iterations / 10 );
+   bson_to_abi_cases( "system_abi", system_abi, iterations / 10 );
+
+   return 0;
+}
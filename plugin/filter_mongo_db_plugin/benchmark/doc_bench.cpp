@@ -0,0 +1,140 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Compares building the filter document of an action with a fresh builder,
+ *  name::to_string per name and an extracted document per action (as the plugin
+ *  used to) with action_doc_builder, which reuses its builder and name strings
+ *  and appends to a doc_buffer. Besides ns_per_op every case reports
+ *  allocs_per_op, counting operator new and libbson allocations.
+ *
+ *  usage: filter_mongo_db_doc_bench [iterations]
+ */
+#include "bench.hpp"
+#include "fixtures.hpp"
+
+#include <eosio/filter_mongo_db_plugin/action_doc.hpp>
+#include <eosio/filter_mongo_db_plugin/bson_convert.hpp>
+
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/types.hpp>
+
+#include <bson.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace eosio;
+using namespace eosio::bench;
+
+namespace {
+
+   std::atomic<uint64_t> allocations{0};
+
+   void* counting_malloc( size_t n ) { ++allocations; return std::malloc( n ); }
+   void* counting_calloc( size_t n, size_t size ) { ++allocations; return std::calloc( n, size ); }
+   void* counting_realloc( void* p, size_t n ) { ++allocations; return std::realloc( p, n ); }
+   void counting_free( void* p ) { std::free( p ); }
+
+}
+
+void* operator new( size_t n ) {
+   ++allocations;
+   if( void* p = std::malloc( n ? n : 1 ))
+      return p;
+   throw std::bad_alloc();
+}
+
+void operator delete( void* p ) noexcept {
+   std::free( p );
+}
+
+namespace {
+
+   using serializer_ptr = action_doc_builder::serializer_ptr;
+
+   /// the document as built before action_doc_builder
+   bsoncxx::document::value build_baseline( const chain::action& act, int32_t act_num, const std::string& trx_id,
+                                            const serializer_ptr& abis ) {
+      using namespace bsoncxx::types;
+      using bsoncxx::builder::basic::kvp;
+
+      auto act_doc = bsoncxx::builder::basic::document();
+      act_doc.append( kvp( "action_num", b_int32{act_num} ),
+                      kvp( "trx_id", trx_id ));
+      act_doc.append( kvp( "cfa", b_bool{false} ));
+      act_doc.append( kvp( "account", act.account.to_string()));
+      act_doc.append( kvp( "name", act.name.to_string()));
+      act_doc.append( kvp( "authorization", [&act]( bsoncxx::builder::basic::sub_array subarr ) {
+         for( const auto& auth : act.authorization ) {
+            subarr.append( [&auth]( bsoncxx::builder::basic::sub_document subdoc ) {
+               subdoc.append( kvp( "actor", auth.actor.to_string()),
+                              kvp( "permission", auth.permission.to_string()));
+            } );
+         }
+      } ));
+      if( abis ) {
+         act_doc.append( kvp( "data", to_bson( abis->binary_to_variant( abis->get_action_type( act.name ), act.data ))));
+      } else {
+         act_doc.append( kvp( "raw_data", b_binary{ bsoncxx::binary_sub_type::k_binary, static_cast<uint32_t>( act.data.size() ),
+                                                    reinterpret_cast<const uint8_t*>( act.data.data() ) } ));
+      }
+      return act_doc.extract();
+   }
+
+   template<typename F>
+   double allocs_per_op( uint64_t iterations, F&& f ) {
+      consume( f() );
+      const uint64_t before = allocations.load();
+      for( uint64_t i = 0; i < iterations; ++i ) {
+         consume( f() );
+      }
+      return double( allocations.load() - before ) / double( iterations ? iterations : 1 );
+   }
+
+   void doc_cases( const std::string& name, const chain::action& act, const serializer_ptr& abis, uint64_t iterations ) {
+      const std::string trx_id( 64, 'a' );
+      auto baseline = [&]() { return build_baseline( act, 0, trx_id, abis ).view().length(); };
+
+      using raw_data_mode = action_doc_builder::raw_data_mode;
+      action_doc_builder builder;
+      doc_buffer out;
+      auto with_builder = [&]( raw_data_mode raw_data ) {
+         return [&, raw_data]() {
+            out.clear();
+            builder.build( act, 0, trx_id, abis, raw_data, out );
+            return out.byte_size();
+         };
+      };
+
+      const auto sample = std::min<uint64_t>( iterations, 1000 );
+      run_case( "action_doc/baseline/" + name, iterations, baseline,
+                fc::mutable_variant_object()( "allocs_per_op", allocs_per_op( sample, baseline )));
+      run_case( "action_doc/builder/" + name, iterations, with_builder( raw_data_mode::fallback ),
+                fc::mutable_variant_object()( "allocs_per_op", allocs_per_op( sample, with_builder( raw_data_mode::fallback ))));
+      run_case( "action_doc/builder_raw_only/" + name, iterations, with_builder( raw_data_mode::only ),
+                fc::mutable_variant_object()( "allocs_per_op", allocs_per_op( sample, with_builder( raw_data_mode::only ))));
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   const bson_mem_vtable_t vtable = { counting_malloc, counting_calloc, counting_realloc, counting_free, { nullptr } };
+   bson_mem_set_vtable( &vtable );
+
+   const uint64_t iterations = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 100000;
+
+   const auto token_abis = std::make_shared<const abi_serializer>( load_abi( token_abi_json ));
+   const auto system_abis = std::make_shared<const abi_serializer>( load_abi( system_abi_json ));
+
+   const auto transfer = make_action( *token_abis, N(eosio.token), N(transfer), token_transfer_json );
+   const auto voteproducer = make_action( *system_abis, N(eosio), N(voteproducer), system_voteproducer_json );
+
+   doc_cases( "token_transfer", transfer, token_abis, iterations );
+   doc_cases( "system_voteproducer", voteproducer, system_abis, iterations );
+   doc_cases( "no_abi", transfer, serializer_ptr(), iterations );
+
+   return 0;
+}
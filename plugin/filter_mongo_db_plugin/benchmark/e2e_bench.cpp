@@ -0,0 +1,270 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Runs chain_plugin and filter_mongo_db_plugin in a scratch data dir, pushes
+ *  synthetic transactions through controller::accepted_transaction, followed by
+ *  a synthetic accepted_block every --trx-per-block transactions, and waits
+ *  until every filtered action has been written.
+ *
+ *  usage: filter_mongo_db_e2e_bench [--transactions N] [--actions-per-trx N] [--filtered-ratio R]
+ *                                   [--payload-bytes N] [--setabi-every N] [--trx-per-block N]
+ *                                   [--timeout-sec N] [-- nodeos options...]
+ *
+ *  Options after -- go to the plugins. Without --filter-mongodb-uri or --filter-mongodb-sink
+ *  the plugin runs with --filter-mongodb-sink null, so no mongod is needed.
+ */
+#include "fixtures.hpp"
+
+#include <eosio/chain_plugin/chain_plugin.hpp>
+#include <eosio/chain/block_state.hpp>
+#include <eosio/chain/transaction_metadata.hpp>
+#include <eosio/filter_mongo_db_plugin.hpp>
+
+#include <fc/io/json.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+using namespace eosio;
+using namespace eosio::bench;
+
+namespace {
+
+   struct bench_config {
+      uint64_t transactions = 100000;
+      uint32_t actions_per_trx = 1;
+      double   filtered_ratio = 0.1;
+      uint32_t payload_bytes = 32;
+      uint64_t setabi_every = 0;
+      uint32_t trx_per_block = 100;
+      uint32_t timeout_sec = 600;
+   };
+
+   uint64_t peak_rss_kb() {
+      struct rusage usage;
+      getrusage( RUSAGE_SELF, &usage );
+#ifdef __APPLE__
+      return usage.ru_maxrss / 1024;
+#else
+      return usage.ru_maxrss;
+#endif
+   }
+
+   chain::transaction_metadata_ptr make_trx( std::vector<chain::action> actions, uint64_t nonce ) {
+      chain::signed_transaction trx;
+      trx.expiration = fc::time_point_sec( fc::time_point::now() ) + 3600;
+      trx.ref_block_prefix = static_cast<uint32_t>( nonce );
+      trx.ref_block_num = static_cast<uint16_t>( nonce >> 32 );
+      trx.actions = std::move( actions );
+      return std::make_shared<chain::transaction_metadata>( trx );
+   }
+
+   /// only what the plugin looks at: number, time and transaction ids
+   chain::block_state_ptr make_block( uint32_t num, const std::vector<chain::transaction_id_type>& ids ) {
+      auto bs = std::make_shared<chain::block_state>();
+      bs->block_num = num;
+      bs->id = fc::sha256::hash( std::to_string( num ));
+      bs->header.timestamp = chain::block_timestamp_type( fc::time_point::now() );
+      bs->block = std::make_shared<chain::signed_block>();
+      bs->block->timestamp = bs->header.timestamp;
+      for( const auto& id : ids ) {
+         bs->block->transactions.emplace_back( id );
+      }
+      return bs;
+   }
+
+   /// the stream to replay and the number of filtered actions in it
+   std::vector<chain::transaction_metadata_ptr> make_stream( const bench_config& cfg, uint64_t& filtered_actions ) {
+      const abi_def token_abi = load_abi( token_abi_json );
+      const abi_serializer token_abis( token_abi );
+      const auto setabi = make_setabi_action( N(eosio.token), token_abi );
+
+      auto args = fc::json::from_string( token_transfer_json ).get_object();
+      fc::mutable_variant_object transfer_args( args );
+      transfer_args( "memo", std::string( cfg.payload_bytes, 'm' ));
+      const auto transfer = make_action( token_abis, N(eosio.token), N(transfer), fc::variant( transfer_args ));
+      const chain::action other( { chain::permission_level{ N(alice), N(active) } }, N(bench.other), N(noop),
+                                 chain::bytes( cfg.payload_bytes, 'x' ));
+
+      std::vector<chain::transaction_metadata_ptr> stream;
+      stream.reserve( cfg.transactions + 1 );
+      stream.emplace_back( make_trx( { setabi }, 0 ));
+      filtered_actions = 0;
+      for( uint64_t i = 0; i < cfg.transactions; ++i ) {
+         if( cfg.setabi_every > 0 && i > 0 && i % cfg.setabi_every == 0 ) {
+            stream.emplace_back( make_trx( { setabi }, ~i ));
+            continue;
+         }
+         const bool filtered = uint64_t( ( i + 1 ) * cfg.filtered_ratio ) > uint64_t( i * cfg.filtered_ratio );
+         stream.emplace_back( make_trx( std::vector<chain::action>( cfg.actions_per_trx, filtered ? transfer : other ), i + 1 ));
+         if( filtered ) {
+            filtered_actions += cfg.actions_per_trx;
+         }
+      }
+      return stream;
+   }
+
+   bool parse_args( int argc, char** argv, bench_config& cfg, std::vector<std::string>& plugin_args ) {
+      int i = 1;
+      for( ; i < argc; ++i ) {
+         const std::string arg = argv[i];
+         if( arg == "--" ) {
+            ++i;
+            break;
+         }
+         if( i + 1 >= argc )
+            return false;
+         const char* value = argv[++i];
+         if( arg == "--transactions" )          cfg.transactions = std::strtoull( value, nullptr, 10 );
+         else if( arg == "--actions-per-trx" )  cfg.actions_per_trx = std::max( 1, std::atoi( value ));
+         else if( arg == "--filtered-ratio" )   cfg.filtered_ratio = std::min( 1.0, std::max( 0.0, std::atof( value )));
+         else if( arg == "--payload-bytes" )    cfg.payload_bytes = std::atoi( value );
+         else if( arg == "--setabi-every" )     cfg.setabi_every = std::strtoull( value, nullptr, 10 );
+         else if( arg == "--trx-per-block" )    cfg.trx_per_block = std::max( 1, std::atoi( value ));
+         else if( arg == "--timeout-sec" )      cfg.timeout_sec = std::atoi( value );
+         else return false;
+      }
+      for( ; i < argc; ++i ) {
+         plugin_args.emplace_back( argv[i] );
+      }
+      return true;
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   bench_config cfg;
+   std::vector<std::string> plugin_args;
+   if( !parse_args( argc, argv, cfg, plugin_args )) {
+      std::cerr << "usage: " << argv[0] << " [--transactions N] [--actions-per-trx N] [--filtered-ratio R] [--payload-bytes N]"
+                << " [--setabi-every N] [--trx-per-block N] [--timeout-sec N] [-- nodeos options...]" << std::endl;
+      return 1;
+   }
+
+   const auto scratch = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path( "filter-mongo-e2e-%%%%-%%%%" );
+   std::vector<std::string> args = {
+         argv[0],
+         "--data-dir", ( scratch / "data" ).string(),
+         "--config-dir", ( scratch / "config" ).string(),
+         "--filter-contract", "eosio.token:transfer"
+   };
+   std::string sink = "mongo";
+   bool have_uri = false;
+   for( size_t i = 0; i < plugin_args.size(); ++i ) {
+      const auto& a = plugin_args[i];
+      if( a.find( "--filter-mongodb-uri" ) == 0 ) {
+         have_uri = true;
+      } else if( a.find( "--filter-mongodb-sink=" ) == 0 ) {
+         sink = a.substr( a.find( '=' ) + 1 );
+      } else if( a == "--filter-mongodb-sink" && i + 1 < plugin_args.size() ) {
+         sink = plugin_args[i + 1];
+      }
+   }
+   if( !have_uri && sink == "mongo" ) {
+      sink = "null";
+      args.emplace_back( "--filter-mongodb-sink" );
+      args.emplace_back( sink );
+   }
+   args.insert( args.end(), plugin_args.begin(), plugin_args.end() );
+
+   int exit_code = 0;
+   try {
+      std::vector<char*> cargs;
+      for( auto& a : args ) {
+         cargs.push_back( &a[0] );
+      }
+      if( !appbase::app().initialize<chain_plugin, filter_mongo_db_plugin>( cargs.size(), cargs.data() )) {
+         boost::filesystem::remove_all( scratch );
+         return 1;
+      }
+      appbase::app().startup();
+
+      uint64_t filtered_actions = 0;
+      const auto stream = make_stream( cfg, filtered_actions );
+      const uint64_t rss_before_kb = peak_rss_kb();
+
+      auto& chain = appbase::app().get_plugin<chain_plugin>().chain();
+      auto& plugin = appbase::app().get_plugin<filter_mongo_db_plugin>();
+
+      const auto start = std::chrono::steady_clock::now();
+      // filtered actions are written once their block is accepted
+      std::vector<chain::transaction_id_type> block_trxs;
+      uint32_t block_num = 1;
+      for( const auto& trx : stream ) {
+         chain.accepted_transaction( trx );
+         block_trxs.emplace_back( trx->id );
+         if( block_trxs.size() >= cfg.trx_per_block ) {
+            chain.accepted_block( make_block( ++block_num, block_trxs ));
+            block_trxs.clear();
+         }
+      }
+      if( !block_trxs.empty() ) {
+         chain.accepted_block( make_block( ++block_num, block_trxs ));
+      }
+      const auto pushed = std::chrono::steady_clock::now();
+
+      fc::variant metrics;
+      bool complete = false;
+      const auto deadline = start + std::chrono::seconds( cfg.timeout_sec );
+      while( std::chrono::steady_clock::now() < deadline ) {
+         metrics = plugin.get_metrics();
+         if( metrics["transactions"].as_uint64() >= stream.size() &&
+             metrics["bulk_writes"]["documents"].as_uint64() >= filtered_actions ) {
+            complete = true;
+            break;
+         }
+         std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+      }
+      const auto finished = std::chrono::steady_clock::now();
+      const double seconds = std::chrono::duration<double>( finished - start ).count();
+      const uint64_t actions = stream.size() * cfg.actions_per_trx;
+
+      const auto& write_latency = metrics["latency_us"]["write"];
+      fc::mutable_variant_object result;
+      result( "case", "e2e" )
+            ( "transactions", stream.size() )
+            ( "actions_per_trx", cfg.actions_per_trx )
+            ( "filtered_ratio", cfg.filtered_ratio )
+            ( "payload_bytes", cfg.payload_bytes )
+            ( "setabi_every", cfg.setabi_every )
+            ( "trx_per_block", cfg.trx_per_block )
+            ( "sink", sink )
+            ( "complete", complete )
+            ( "filtered_actions", filtered_actions )
+            ( "written_actions", metrics["bulk_writes"]["documents"] )
+            ( "seconds", seconds )
+            ( "push_seconds", std::chrono::duration<double>( pushed - start ).count() )
+            ( "trx_per_sec", stream.size() / seconds )
+            ( "actions_per_sec", actions / seconds )
+            ( "e2e_latency_p50_us", write_latency["p50"] )
+            ( "e2e_latency_p99_us", write_latency["p99"] )
+            ( "queue_latency_p99_us", metrics["latency_us"]["queue"]["p99"] )
+            ( "decode_latency_p99_us", metrics["latency_us"]["decode"]["p99"] )
+            ( "rss_before_kb", rss_before_kb )
+            ( "peak_rss_kb", peak_rss_kb() );
+      std::cout << fc::json::to_string( result, fc::json::legacy_generator ) << std::endl;
+      if( !complete ) {
+         std::cerr << "timed out waiting for the filtered actions to be written" << std::endl;
+         exit_code = 1;
+      }
+
+      appbase::app().shutdown();
+   } catch( const fc::exception& e ) {
+      std::cerr << e.to_detail_string() << std::endl;
+      exit_code = 1;
+   } catch( const std::exception& e ) {
+      std::cerr << e.what() << std::endl;
+      exit_code = 1;
+   }
+
+   boost::filesystem::remove_all( scratch );
+   return exit_code;
+}
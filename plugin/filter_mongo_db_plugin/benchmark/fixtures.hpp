@@ -0,0 +1,157 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/abi_serializer.hpp>
+#include <eosio/chain/action.hpp>
+#include <eosio/chain/contract_types.hpp>
+
+#include <fc/io/json.hpp>
+
+namespace eosio { namespace bench {
+
+using chain::abi_def;
+using chain::abi_serializer;
+
+/// eosio.token abi as deployed by the reference contract
+static const char* const token_abi_json = R"=====(
+{
+  "types": [{ "new_type_name": "account_name", "type": "name" }],
+  "structs": [
+    { "name": "transfer", "base": "", "fields": [
+        { "name": "from", "type": "account_name" },
+        { "name": "to", "type": "account_name" },
+        { "name": "quantity", "type": "asset" },
+        { "name": "memo", "type": "string" } ] },
+    { "name": "create", "base": "", "fields": [
+        { "name": "issuer", "type": "account_name" },
+        { "name": "maximum_supply", "type": "asset" } ] },
+    { "name": "issue", "base": "", "fields": [
+        { "name": "to", "type": "account_name" },
+        { "name": "quantity", "type": "asset" },
+        { "name": "memo", "type": "string" } ] },
+    { "name": "account", "base": "", "fields": [
+        { "name": "balance", "type": "asset" } ] },
+    { "name": "currency_stats", "base": "", "fields": [
+        { "name": "supply", "type": "asset" },
+        { "name": "max_supply", "type": "asset" },
+        { "name": "issuer", "type": "account_name" } ] }
+  ],
+  "actions": [
+    { "name": "transfer", "type": "transfer", "ricardian_contract": "" },
+    { "name": "issue", "type": "issue", "ricardian_contract": "" },
+    { "name": "create", "type": "create", "ricardian_contract": "" }
+  ],
+  "tables": [
+    { "name": "accounts", "index_type": "i64", "key_names": ["currency"], "key_types": ["uint64"], "type": "account" },
+    { "name": "stat", "index_type": "i64", "key_names": ["currency"], "key_types": ["uint64"], "type": "currency_stats" }
+  ],
+  "ricardian_clauses": [],
+  "abi_extensions": []
+}
+)=====";
+
+/// the part of the eosio.system abi used by account creation and resource actions
+static const char* const system_abi_json = R"=====(
+{
+  "types": [
+    { "new_type_name": "account_name", "type": "name" },
+    { "new_type_name": "permission_name", "type": "name" },
+    { "new_type_name": "weight_type", "type": "uint16" }
+  ],
+  "structs": [
+    { "name": "permission_level", "base": "", "fields": [
+        { "name": "actor", "type": "account_name" },
+        { "name": "permission", "type": "permission_name" } ] },
+    { "name": "key_weight", "base": "", "fields": [
+        { "name": "key", "type": "public_key" },
+        { "name": "weight", "type": "weight_type" } ] },
+    { "name": "permission_level_weight", "base": "", "fields": [
+        { "name": "permission", "type": "permission_level" },
+        { "name": "weight", "type": "weight_type" } ] },
+    { "name": "wait_weight", "base": "", "fields": [
+        { "name": "wait_sec", "type": "uint32" },
+        { "name": "weight", "type": "weight_type" } ] },
+    { "name": "authority", "base": "", "fields": [
+        { "name": "threshold", "type": "uint32" },
+        { "name": "keys", "type": "key_weight[]" },
+        { "name": "accounts", "type": "permission_level_weight[]" },
+        { "name": "waits", "type": "wait_weight[]" } ] },
+    { "name": "newaccount", "base": "", "fields": [
+        { "name": "creator", "type": "account_name" },
+        { "name": "name", "type": "account_name" },
+        { "name": "owner", "type": "authority" },
+        { "name": "active", "type": "authority" } ] },
+    { "name": "setabi", "base": "", "fields": [
+        { "name": "account", "type": "account_name" },
+        { "name": "abi", "type": "bytes" } ] },
+    { "name": "buyrambytes", "base": "", "fields": [
+        { "name": "payer", "type": "account_name" },
+        { "name": "receiver", "type": "account_name" },
+        { "name": "bytes", "type": "uint32" } ] },
+    { "name": "delegatebw", "base": "", "fields": [
+        { "name": "from", "type": "account_name" },
+        { "name": "receiver", "type": "account_name" },
+        { "name": "stake_net_quantity", "type": "asset" },
+        { "name": "stake_cpu_quantity", "type": "asset" },
+        { "name": "transfer", "type": "bool" } ] },
+    { "name": "voteproducer", "base": "", "fields": [
+        { "name": "voter", "type": "account_name" },
+        { "name": "proxy", "type": "account_name" },
+        { "name": "producers", "type": "account_name[]" } ] }
+  ],
+  "actions": [
+    { "name": "newaccount", "type": "newaccount", "ricardian_contract": "" },
+    { "name": "setabi", "type": "setabi", "ricardian_contract": "" },
+    { "name": "buyrambytes", "type": "buyrambytes", "ricardian_contract": "" },
+    { "name": "delegatebw", "type": "delegatebw", "ricardian_contract": "" },
+    { "name": "voteproducer", "type": "voteproducer", "ricardian_contract": "" }
+  ],
+  "tables": [],
+  "ricardian_clauses": [],
+  "abi_extensions": []
+}
+)=====";
+
+static const char* const token_transfer_json = R"=====(
+{ "from": "alice", "to": "bob", "quantity": "12.3456 SYS", "memo": "payment for order 4521" }
+)=====";
+
+static const char* const system_newaccount_json = R"=====(
+{
+  "creator": "eosio",
+  "name": "alice",
+  "owner": { "threshold": 1, "keys": [{ "key": "EOS6MRyAjQq8ud7hVNYcfnVPJqcVpscN5So8BhtHuGYqET5GDW5CV", "weight": 1 }], "accounts": [], "waits": [] },
+  "active": { "threshold": 1, "keys": [{ "key": "EOS6MRyAjQq8ud7hVNYcfnVPJqcVpscN5So8BhtHuGYqET5GDW5CV", "weight": 1 }], "accounts": [], "waits": [] }
+}
+)=====";
+
+static const char* const system_voteproducer_json = R"=====(
+{ "voter": "alice", "proxy": "", "producers": ["bp1", "bp2", "bp3", "bp4", "bp5", "bp21", "bp22", "bp23", "bp24", "bp25"] }
+)=====";
+
+inline abi_def load_abi( const char* json ) {
+   return fc::json::from_string( json ).as<abi_def>();
+}
+
+/// serialized action as it arrives in a transaction
+inline chain::action make_action( const abi_serializer& abis, chain::account_name account, chain::action_name name, const fc::variant& args ) {
+   auto data = abis.variant_to_binary( abis.get_action_type( name ), args );
+   return chain::action( { chain::permission_level{ N(alice), N(active) } }, account, name, data );
+}
+
+inline chain::action make_action( const abi_serializer& abis, chain::account_name account, chain::action_name name, const char* json ) {
+   return make_action( abis, account, name, fc::json::from_string( json ));
+}
+
+/// setabi action carrying abi in packed form
+inline chain::action make_setabi_action( chain::account_name account, const abi_def& abi ) {
+   chain::setabi sa;
+   sa.account = account;
+   sa.abi = fc::raw::pack( abi );
+   return chain::action( { chain::permission_level{ account, N(active) } }, sa );
+}
+
+} }
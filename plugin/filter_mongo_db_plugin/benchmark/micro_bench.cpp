@@ -0,0 +1,183 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Isolated cases for the steps one filtered action goes through, on the
+ *  fixture abis and actions and without MongoDB:
+ *
+ *    abi_load/...           abi of a filter contract from the account registry or an accounts document
+ *    abi_serializer/...     abi_serializer construction
+ *    binary_to_variant/...  decoding action data with the abi, or natively as the plugin does for eosio
+ *    bson/...               variant <-> BSON, directly and through JSON
+ *    action_doc/...         assembling the filter document of an action
+ *    filter/...             matching actions against the filter-contract rules
+ *
+ *  Every case prints one JSON object as in the other benchmarks. A case prefix
+ *  runs only the matching cases.
+ *
+ *  usage: filter_mongo_db_micro_bench [iterations] [case prefix]
+ */
+#include "bench.hpp"
+#include "fixtures.hpp"
+
+#include <eosio/filter_mongo_db_plugin/account_registry.hpp>
+#include <eosio/filter_mongo_db_plugin/action_doc.hpp>
+#include <eosio/filter_mongo_db_plugin/action_filter.hpp>
+#include <eosio/filter_mongo_db_plugin/bson_convert.hpp>
+
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/json.hpp>
+
+#include <cstdlib>
+
+using namespace eosio;
+using namespace eosio::bench;
+
+namespace {
+
+   std::string selected;
+
+   template<typename F>
+   void maybe_run( const std::string& name, uint64_t iterations, F&& f ) {
+      if( name.compare( 0, selected.size(), selected ) == 0 )
+         run_case( name, iterations, std::forward<F>( f ));
+   }
+
+   using serializer_ptr = action_doc_builder::serializer_ptr;
+
+   void abi_load_cases( const std::string& name, const account_registry& registry, const account_name& account,
+                        const abi_def& abi, uint64_t iterations ) {
+      using bsoncxx::builder::basic::make_document;
+      using bsoncxx::builder::basic::kvp;
+
+      maybe_run( "abi_load/registry/" + name, iterations, [&]() {
+         return registry.abi( account )->structs.size();
+      } );
+      // a cache miss of the plugin builds the serializer from the registry
+      maybe_run( "abi_load/registry_serializer/" + name, iterations / 10, [&]() {
+         return abi_serializer( *registry.abi( account )).get_action_type( N(transfer) ).size();
+      } );
+      // as load_accounts reads the accounts collection on startup
+      const auto doc = make_document( kvp( "name", account.to_string() ), kvp( "abi", to_bson( abi )));
+      const auto view = doc.view();
+      maybe_run( "abi_load/accounts_doc/" + name, iterations / 10, [&]() {
+         return from_bson( view["abi"].get_document().value ).as<abi_def>().structs.size();
+      } );
+   }
+
+   void abi_serializer_cases( const std::string& name, const abi_def& abi, uint64_t iterations ) {
+      maybe_run( "abi_serializer/construct/" + name, iterations, [&]() {
+         return abi_serializer( abi ).get_action_type( N(transfer) ).size();
+      } );
+   }
+
+   void binary_to_variant_cases( const std::string& name, const abi_serializer& abis, const chain::action& act, uint64_t iterations ) {
+      const auto type = abis.get_action_type( act.name );
+      maybe_run( "binary_to_variant/abi/" + name, iterations, [&]() {
+         return abis.binary_to_variant( type, act.data ).get_object().size();
+      } );
+   }
+
+   void bson_cases( const std::string& name, const fc::variant& v, uint64_t iterations ) {
+      maybe_run( "bson/variant_to_bson_json/" + name, iterations, [&]() {
+         return bsoncxx::from_json( fc::json::to_string( v )).view().length();
+      } );
+      maybe_run( "bson/variant_to_bson/" + name, iterations, [&]() {
+         return to_bson( v ).view().length();
+      } );
+      const auto doc = to_bson( v );
+      const auto view = doc.view();
+      maybe_run( "bson/bson_to_variant_json/" + name, iterations, [&]() {
+         return fc::json::from_string( bsoncxx::to_json( view )).get_object().size();
+      } );
+      maybe_run( "bson/bson_to_variant/" + name, iterations, [&]() {
+         return from_bson( view ).get_object().size();
+      } );
+   }
+
+   void action_doc_cases( const std::string& name, const chain::action& act, const serializer_ptr& abis, uint64_t iterations ) {
+      const std::string trx_id( 64, 'a' );
+      action_doc_builder builder;
+      doc_buffer out;
+      maybe_run( "action_doc/build/" + name, iterations, [&]() {
+         out.clear();
+         builder.build( act, 0, trx_id, abis, action_doc_builder::raw_data_mode::fallback, out );
+         return out.byte_size();
+      } );
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   const uint64_t iterations = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 100000;
+   if( argc > 2 )
+      selected = argv[2];
+
+   const auto token_abi = load_abi( token_abi_json );
+   const auto system_abi = load_abi( system_abi_json );
+   const auto token_abis = std::make_shared<const abi_serializer>( token_abi );
+   const auto system_abis = std::make_shared<const abi_serializer>( system_abi );
+
+   const auto transfer = make_action( *token_abis, N(eosio.token), N(transfer), token_transfer_json );
+   const auto newaccount = make_action( *system_abis, N(eosio), N(newaccount), system_newaccount_json );
+   const auto voteproducer = make_action( *system_abis, N(eosio), N(voteproducer), system_voteproducer_json );
+   const auto setabi = make_setabi_action( N(eosio.token), token_abi );
+
+   // abi load
+   account_registry registry;
+   registry.track( N(eosio.token) );
+   registry.track( N(eosio) );
+   registry.load( N(eosio.token), std::make_shared<const abi_def>( token_abi ));
+   registry.load( N(eosio), std::make_shared<const abi_def>( system_abi ));
+   abi_load_cases( "token_abi", registry, N(eosio.token), token_abi, iterations );
+   abi_load_cases( "system_abi", registry, N(eosio), system_abi, iterations );
+
+   // abi_serializer construction
+   abi_serializer_cases( "token_abi", token_abi, iterations / 10 );
+   abi_serializer_cases( "system_abi", system_abi, iterations / 10 );
+
+   // binary_to_variant
+   binary_to_variant_cases( "token_transfer", *token_abis, transfer, iterations );
+   binary_to_variant_cases( "system_newaccount", *system_abis, newaccount, iterations );
+   binary_to_variant_cases( "system_setabi", *system_abis, setabi, iterations );
+   binary_to_variant_cases( "system_voteproducer", *system_abis, voteproducer, iterations );
+   maybe_run( "binary_to_variant/native/system_newaccount", iterations, [&]() {
+      fc::variant v;
+      fc::to_variant( newaccount.data_as<chain::newaccount>(), v );
+      return v.get_object().size();
+   } );
+   maybe_run( "binary_to_variant/native/system_setabi", iterations / 10, [&]() {
+      const auto sa = setabi.data_as<chain::setabi>();
+      return fc::raw::unpack<abi_def>( sa.abi ).structs.size();
+   } );
+
+   // JSON <-> BSON
+   auto decoded = []( const abi_serializer& abis, const chain::action& act ) {
+      return abis.binary_to_variant( abis.get_action_type( act.name ), act.data );
+   };
+   bson_cases( "token_transfer", decoded( *token_abis, transfer ), iterations );
+   bson_cases( "system_newaccount", decoded( *system_abis, newaccount ), iterations );
+   bson_cases( "system_voteproducer", decoded( *system_abis, voteproducer ), iterations );
+
+   // act_doc assembly
+   action_doc_cases( "token_transfer", transfer, token_abis, iterations );
+   action_doc_cases( "system_newaccount", newaccount, system_abis, iterations );
+   action_doc_cases( "system_setabi", setabi, system_abis, iterations / 10 );
+   action_doc_cases( "no_abi", transfer, serializer_ptr(), iterations );
+
+   // filter lookup, with rules of every kind and a few dozen contracts
+   action_filter filter;
+   filter.add_rule( "eosio.token:transfer" );
+   filter.add_rule( "eosio:newaccount:alice" );
+   for( char a = 'a'; a < 'f'; ++a ) {
+      for( char b = 'a'; b < 'k'; ++b ) {
+         filter.add_rule( std::string( "contract" ) + a + b );
+      }
+   }
+   maybe_run( "filter/match/token_transfer", iterations * 10, [&]() { return size_t( filter.match( transfer )); } );
+   maybe_run( "filter/match_actor/system_newaccount", iterations * 10, [&]() { return size_t( filter.match( newaccount )); } );
+   maybe_run( "filter/miss/system_voteproducer", iterations * 10, [&]() { return size_t( filter.match( voteproducer )); } );
+
+   return 0;
+}
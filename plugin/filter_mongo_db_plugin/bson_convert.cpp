@@ -0,0 +1,165 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/filter_mongo_db_plugin/bson_convert.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/utf8.hpp>
+
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/builder/basic/sub_array.hpp>
+#include <bsoncxx/types.hpp>
+
+#include <limits>
+
+namespace eosio {
+
+namespace {
+
+   using bsoncxx::builder::basic::kvp;
+   using bsoncxx::builder::basic::sub_array;
+   using bsoncxx::builder::basic::sub_document;
+
+   void append_object( sub_document& doc, const fc::variant_object& obj );
+   void append_array( sub_array& arr, const fc::variants& vars );
+
+   const std::string& checked_utf8( const std::string& s ) {
+      FC_ASSERT( fc::is_utf8( s ), "Invalid UTF-8 string" );
+      return s;
+   }
+
+   // fc::json::to_string writes integers above 0xffffffff as strings, bsoncxx::from_json
+   // reads the remaining ones as int32 when they fit
+   template<typename Append>
+   void append_integer( int64_t i, Append& append ) {
+      if( i >= std::numeric_limits<int32_t>::min() && i <= std::numeric_limits<int32_t>::max() ) {
+         append( bsoncxx::types::b_int32{static_cast<int32_t>( i )} );
+      } else {
+         append( bsoncxx::types::b_int64{i} );
+      }
+   }
+
+   template<typename Append>
+   void append_value( const fc::variant& v, Append&& append ) {
+      switch( v.get_type() ) {
+         case fc::variant::null_type:
+            append( bsoncxx::types::b_null{} );
+            break;
+         case fc::variant::int64_type: {
+            const int64_t i = v.as_int64();
+            if( i > 0xffffffff ) {
+               append( v.as_string() );
+            } else {
+               append_integer( i, append );
+            }
+            break;
+         }
+         case fc::variant::uint64_type: {
+            const uint64_t i = v.as_uint64();
+            if( i > 0xffffffff ) {
+               append( v.as_string() );
+            } else {
+               append_integer( static_cast<int64_t>( i ), append );
+            }
+            break;
+         }
+         case fc::variant::double_type:
+         case fc::variant::blob_type:
+            append( v.as_string() );
+            break;
+         case fc::variant::bool_type:
+            append( bsoncxx::types::b_bool{v.as_bool()} );
+            break;
+         case fc::variant::string_type:
+            append( bsoncxx::types::b_utf8{checked_utf8( v.get_string() )} );
+            break;
+         case fc::variant::array_type:
+            append( [&v]( sub_array arr ) { append_array( arr, v.get_array() ); } );
+            break;
+         case fc::variant::object_type:
+            append( [&v]( sub_document sub ) { append_object( sub, v.get_object() ); } );
+            break;
+         default:
+            FC_THROW( "Unsupported variant type ${t}", ("t", static_cast<int>( v.get_type() )) );
+      }
+   }
+
+   void append_object( sub_document& doc, const fc::variant_object& obj ) {
+      for( const auto& entry : obj ) {
+         append_variant( doc, entry.key(), entry.value() );
+      }
+   }
+
+   void append_array( sub_array& arr, const fc::variants& vars ) {
+      for( const auto& v : vars ) {
+         append_value( v, [&arr]( auto&& value ) { arr.append( std::forward<decltype(value)>( value )); } );
+      }
+   }
+
+   fc::variant element_to_variant( const bsoncxx::document::element& e );
+   fc::variant element_to_variant( const bsoncxx::array::element& e );
+
+   template<typename Element>
+   fc::variant value_to_variant( const Element& e ) {
+      switch( e.type() ) {
+         case bsoncxx::type::k_utf8: {
+            auto s = e.get_utf8().value;
+            return fc::variant( std::string( s.data(), s.size() ));
+         }
+         case bsoncxx::type::k_int32:
+            return fc::variant( static_cast<int64_t>( e.get_int32().value ));
+         case bsoncxx::type::k_int64:
+            return fc::variant( static_cast<int64_t>( e.get_int64().value ));
+         case bsoncxx::type::k_double:
+            return fc::variant( e.get_double().value );
+         case bsoncxx::type::k_bool:
+            return fc::variant( e.get_bool().value );
+         case bsoncxx::type::k_null:
+            return fc::variant();
+         case bsoncxx::type::k_document:
+            return from_bson( e.get_document().value );
+         case bsoncxx::type::k_array: {
+            fc::variants vars;
+            for( const auto& ae : e.get_array().value ) {
+               vars.emplace_back( element_to_variant( ae ));
+            }
+            return fc::variant( std::move( vars ));
+         }
+         default:
+            FC_THROW( "Unsupported BSON type ${t}", ("t", bsoncxx::to_string( e.type() )) );
+      }
+   }
+
+   fc::variant element_to_variant( const bsoncxx::document::element& e ) { return value_to_variant( e ); }
+   fc::variant element_to_variant( const bsoncxx::array::element& e ) { return value_to_variant( e ); }
+
+}
+
+void append_variant( sub_document& doc, const std::string& key, const fc::variant& v ) {
+   checked_utf8( key );
+   append_value( v, [&doc, &key]( auto&& value ) { doc.append( kvp( key, std::forward<decltype(value)>( value ))); } );
+}
+
+bsoncxx::document::value to_bson( const fc::variant_object& obj ) {
+   bsoncxx::builder::basic::document doc;
+   append_object( doc, obj );
+   return doc.extract();
+}
+
+bsoncxx::document::value to_bson( const fc::variant& v ) {
+   FC_ASSERT( v.is_object(), "Only objects can be converted to a BSON document" );
+   return to_bson( v.get_object() );
+}
+
+fc::variant from_bson( const bsoncxx::document::view& view ) {
+   fc::mutable_variant_object obj;
+   for( const auto& e : view ) {
+      auto key = e.key();
+      obj( std::string( key.data(), key.size() ), element_to_variant( e ));
+   }
+   return fc::variant( std::move( obj ));
+}
+
+}
@@ -3,29 +3,54 @@
  *  @copyright defined in eos/LICENSE.txt
  */
 #include <eosio/filter_mongo_db_plugin.hpp>
+#include <eosio/filter_mongo_db_plugin/account_registry.hpp>
+#include <eosio/filter_mongo_db_plugin/action_doc.hpp>
+#include <eosio/filter_mongo_db_plugin/action_filter.hpp>
+#include <eosio/filter_mongo_db_plugin/action_sink.hpp>
+#include <eosio/filter_mongo_db_plugin/action_stats.hpp>
+#include <eosio/filter_mongo_db_plugin/bson_convert.hpp>
+#include <eosio/filter_mongo_db_plugin/doc_buffer.hpp>
+#include <eosio/filter_mongo_db_plugin/pipeline_metrics.hpp>
+#include <eosio/filter_mongo_db_plugin/spill_log.hpp>
+#include <eosio/filter_mongo_db_plugin/spsc_ring.hpp>
+#include <eosio/filter_mongo_db_plugin/trx_dedup.hpp>
 #include <eosio/chain/eosio_contract.hpp>
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/trace.hpp>
 #include <eosio/chain/transaction.hpp>
 #include <eosio/chain/types.hpp>
 
 #include <fc/io/json.hpp>
 #include <fc/variant.hpp>
 
+#include <boost/asio/io_service.hpp>
 #include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/signals2/connection.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
 
+#include <algorithm>
+#include <limits>
+#include <functional>
+#include <list>
 #include <queue>
+#include <unordered_map>
 
+#include <bsoncxx/builder/basic/array.hpp>
 #include <bsoncxx/builder/basic/kvp.hpp>
 #include <bsoncxx/builder/basic/document.hpp>
 #include <bsoncxx/json.hpp>
 
 #include <mongocxx/client.hpp>
 #include <mongocxx/instance.hpp>
+#include <mongocxx/pool.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/options/index.hpp>
+#include <mongocxx/options/update.hpp>
 
 namespace fc { class variant; }
 
@@ -44,141 +69,580 @@ using chain::packed_transaction;
 
 static appbase::abstract_plugin& _filter_mongo_db_plugin = app().register_plugin<filter_mongo_db_plugin>();
 
+namespace {
+
+/**
+ * Bounded LRU cache of ready abi_serializers keyed by account name value.
+ * A null entry records that the account has no usable abi, so actions of such
+ * accounts do not build a serializer on every call either.
+ */
+class abi_serializer_cache {
+public:
+   using serializer_ptr = std::shared_ptr<const abi_serializer>;
+
+   explicit abi_serializer_cache( size_t max_size = 0 ) : max_size( max_size ) {}
+
+   void set_max_size( size_t s ) {
+      max_size = s;
+      trim();
+   }
+
+   bool find( const account_name& n, serializer_ptr& result ) {
+      auto itr = index.find( n.value );
+      if( itr == index.end() )
+         return false;
+      lru.splice( lru.begin(), lru, itr->second );
+      result = itr->second->second;
+      return true;
+   }
+
+   void put( const account_name& n, serializer_ptr abis ) {
+      if( max_size == 0 ) return;
+      auto itr = index.find( n.value );
+      if( itr != index.end() ) {
+         itr->second->second = std::move( abis );
+         lru.splice( lru.begin(), lru, itr->second );
+         return;
+      }
+      lru.emplace_front( n.value, std::move( abis ) );
+      index[n.value] = lru.begin();
+      trim();
+   }
+
+   void erase( const account_name& n ) {
+      auto itr = index.find( n.value );
+      if( itr != index.end() ) {
+         lru.erase( itr->second );
+         index.erase( itr );
+      }
+   }
+
+   size_t size()const { return index.size(); }
+
+private:
+   void trim() {
+      while( index.size() > max_size ) {
+         index.erase( lru.back().first );
+         lru.pop_back();
+      }
+   }
+
+   using entry = std::pair<uint64_t, serializer_ptr>;
+
+   size_t max_size;
+   std::list<entry> lru;
+   std::unordered_map<uint64_t, std::list<entry>::iterator> index;
+};
+
+}
+
 class filter_mongo_db_plugin_impl {
 public:
    filter_mongo_db_plugin_impl();
    ~filter_mongo_db_plugin_impl();
 
    fc::optional<boost::signals2::scoped_connection> accepted_transaction_connection;
+   fc::optional<boost::signals2::scoped_connection> applied_transaction_connection;
+   fc::optional<boost::signals2::scoped_connection> accepted_block_connection;
+   fc::optional<boost::signals2::scoped_connection> irreversible_block_connection;
+
+   // everything the consume thread gets from the controller, in signal order
+   struct queued_event {
+      enum kind_type : uint8_t {
+         transaction,
+         applied_transaction,
+         accepted_block,
+         irreversible_block
+      };
+      kind_type                                kind = transaction;
+      chain::transaction_metadata_ptr          trx;
+      chain::transaction_trace_ptr             trace;
+      chain::block_state_ptr                   block;
+      boost::chrono::steady_clock::time_point  queued_at;
+   };
 
    void accepted_transaction(const chain::transaction_metadata_ptr&);
-   void process_accepted_transaction(const chain::transaction_metadata_ptr&);
-   void _process_accepted_transaction(const chain::transaction_metadata_ptr&);
+   void applied_transaction(const chain::transaction_trace_ptr&);
+   void accepted_block(const chain::block_state_ptr&);
+   void irreversible_block(const chain::block_state_ptr&);
+   void on_event(queued_event&& e);
+   void queue_event(queued_event&& e);
+   void process_event(const queued_event& e);
+   void process_accepted_transaction(const chain::transaction_metadata_ptr&, const boost::chrono::steady_clock::time_point& queued_at);
+   void _process_accepted_transaction(const chain::transaction_metadata_ptr&, const boost::chrono::steady_clock::time_point& queued_at);
+   void process_applied_transaction(const chain::transaction_trace_ptr&, const boost::chrono::steady_clock::time_point& queued_at);
+   void process_accepted_block(const chain::block_state_ptr&);
+   void process_irreversible_block(const chain::block_state_ptr&);
 
    void init();
+   void create_indexes( mongocxx::client& client, bool background );
+   void load_accounts();
    void wipe_database();
 
+   abi_serializer_cache::serializer_ptr get_abi_serializer( const account_name& n );
+   template<typename T>
+   fc::variant to_variant_with_abi( const T& obj );
+   void update_account( const chain::action& act );
+   void flush_accounts();
+   void track_account( const account_name& n );
+
    bool configured{false};
    bool wipe_database_on_startup{false};
    uint32_t start_block_num = 0;
-   bool start_block_reached = false;
+   // transactions are decoded from the block before the start block on; those queued before the first
+   // accepted block are decoded too and dropped if their block turns out to be before the start block
+   bool start_block_reached = true;
 
-   vector<string>  filter_contract;
+   action_filter filter;
 
    std::string db_name;
    mongocxx::instance mongo_inst;
-   mongocxx::client mongo_conn;
+   // both stay empty without filter-mongodb-uri, accounts are then only kept in memory
+   std::unique_ptr<mongocxx::pool> mongo_pool;
+   // client of the consume thread, used for the account and abi bookkeeping
+   mongocxx::pool::entry mongo_conn;
    mongocxx::collection accounts;
 
+   // account changes are upserted once per batch latency, abis are only ever read from the registry
+   account_registry registry;
+   boost::chrono::steady_clock::time_point accounts_pending_since;
+   abi_serializer_cache abi_cache;
+   uint32_t abi_warm_threads = 0;
+
+   // transactions with filtered actions or account bookkeeping that were processed already; a transaction
+   // is forgotten once it is in a block, so it is processed again if that block is forked out
+   trx_dedup seen_trxs{ 0, chain::config::default_max_trx_lifetime };
+   bool upsert = false;
+
+   // filtered actions come from the action traces of applied transactions, inline actions and notifications
+   // included; the accepted transactions are then only used for the account bookkeeping. The last trace of
+   // a transaction before its block is accepted replaces the documents of earlier ones, so traces with
+   // filtered actions are remembered until then in case a later one has none
+   bool inline_actions = false;
+   trx_dedup seen_traces{ 0, chain::config::default_max_trx_lifetime };
+   fc::time_point_sec head_block_time;
+
+   using raw_data_mode = action_doc_builder::raw_data_mode;
+   raw_data_mode raw_data = raw_data_mode::fallback;
+
+   bool index_accounts_name = true;
+   bool index_filter_trx_id = true;
+   bool index_filter_account_name = true;
+   bool index_filter_block_num = true;
+   // after a wipe the indexes are built in the background once the head block is recent
+   bool indexes_deferred = false;
+   static const fc::microseconds caught_up_block_age;
+   boost::thread index_thread;
+
    size_t queue_size = 0;
-   std::deque<chain::transaction_metadata_ptr> transaction_metadata_queue;
-   std::deque<chain::transaction_metadata_ptr> transaction_metadata_process_queue;
 
-   // transaction.id -> actions
-   std::map<std::string, std::vector<chain::action>> reversible_actions;
-   boost::mutex mtx;
-   boost::condition_variable condition;
+   pipeline_metrics metrics;
+   boost::chrono::seconds metrics_log_interval{0};
+   boost::chrono::steady_clock::time_point metrics_logged_at;
+   uint64_t metrics_logged_transactions = 0;
+   uint64_t metrics_logged_actions = 0;
+
+   fc::variant get_metrics()const;
+   void log_metrics();
+
+   // what the producer does when the ring between nodeos and the consume thread is full
+   enum class overflow_policy {
+      block, // wait until the consume thread catches up
+      drop,  // drop the transaction and count it, block events are never dropped
+      spill  // move it to a bounded overflow queue drained after the ring, block once that is full
+   };
+   overflow_policy queue_overflow = overflow_policy::block;
+   std::unique_ptr<spsc_ring<queued_event>> event_queue;
+   boost::mutex spill_mtx;
+   boost::condition_variable spill_cv;
+   std::deque<queued_event> event_spill;
+   size_t spill_max_events = 0;
+   std::atomic<size_t> spill_size{0};
+   std::atomic<uint64_t> producer_blocked_us{0};
+   std::atomic<uint64_t> dropped_transactions{0};
+   std::atomic<uint64_t> spilled_events{0};
+
+   // filtered action documents collected across transactions, one bulk write per writer and flush
+   size_t batch_max_docs = 0;
+   size_t batch_max_bytes = 0;
+   boost::chrono::milliseconds batch_max_latency{0};
+   std::vector<doc_buffer> pending_filter_docs; // per writer
+   std::vector<boost::chrono::steady_clock::time_point> pending_queued_at; // oldest transaction per writer
+   size_t pending_filter_count = 0;
+   size_t pending_filter_bytes = 0;
+   boost::chrono::steady_clock::time_point pending_since;
+
+   // writer threads each own a partition of the contracts (or transactions), so the order per
+   // contract is kept while different partitions write in parallel, each to a sink of its own
+   enum class partition_key {
+      account,
+      trx_id
+   };
+   enum class sink_type {
+      mongo,
+      file,
+      null
+   };
+   struct write_batch {
+      doc_buffer                               docs;
+      boost::chrono::steady_clock::time_point  queued_at;
+      bool                                     relaxed = false; // collected in catch-up mode
+      uint64_t                                 seq = 0; // of the flush
+   };
+   struct filter_writer {
+      boost::thread                                      thread;
+      boost::mutex                                       mtx;
+      boost::condition_variable                          cv;
+      std::deque<write_batch>                            batches;
+      std::unique_ptr<action_sink>                       sink;
+      // documents the sink could not keep up with, always newer than the queued batches
+      std::unique_ptr<spill_log>                         spill;
+      bool                                               done = false;
+      // the oldest flush with documents not known to be stored, 0 for none: the batch being written (or lost),
+      // the spilled documents, unacknowledged writes not synced yet and rejected writes, kept until a restart
+      uint64_t                                           unwritten_seq = 0;
+      uint64_t                                           spilled_seq = 0;
+      uint64_t                                           unsynced_seq = 0;
+      uint64_t                                           rejected_seq = 0;
+   };
+   static constexpr size_t writer_max_queued_batches = 4;
+   partition_key writer_partition = partition_key::account;
+   sink_type output_sink = sink_type::mongo;
+   boost::filesystem::path output_dir;
+   uint64_t output_segment_size = 0;
+   boost::chrono::seconds output_segment_age{0};
+   std::vector<std::unique_ptr<filter_writer>> writers;
+   boost::filesystem::path spill_dir;
+   uint64_t spill_segment_size = 0;
+   std::atomic<uint64_t> spilled_filter_docs{0};
+
+   // catch-up mode: while the accepted blocks are old, batches are larger and written with a relaxed
+   // write concern; once blocks are recent again every writer syncs before its next safe write
+   bool catch_up_enabled = false;
+   size_t catch_up_batch_docs = 0;
+   mongocxx::write_concern catch_up_concern;
+   std::atomic<bool> catching_up{false};
+   static const fc::microseconds catch_up_block_age;
+   static const boost::chrono::seconds unacknowledged_sync_interval;
+
+   size_t partition_of( const bsoncxx::document::view& doc )const;
+   void start_writers( uint32_t n );
+   void stop_writers();
+   void writer_loop( filter_writer& w );
+   action_sink::write_result write_filter_docs( action_sink& sink, const doc_buffer& docs, bool relaxed );
+   bool sync_sink( action_sink& sink );
+   size_t spill_filter_docs( filter_writer& w, const doc_buffer& docs, uint64_t seq );
+
+   // the last block whose filtered actions are all stored, kept in filter_meta so a restart resumes after
+   // it; before a block reaches the writers it is reserved there too, and actions of reserved blocks are
+   // upserted after a restart, so whatever was written past the checkpoint is not written twice
+   struct block_ref {
+      uint32_t        block_num = 0;
+      block_id_type   block_id;
+   };
+   bool checkpoint_enabled = false;
+   fc::optional<block_ref> resume_block;   // the checkpoint found on startup, until its height is accepted again
+   uint32_t upsert_until_block = 0;        // the reservation found on startup
+   uint32_t reserved_block_num = 0;
+   static constexpr uint32_t reserve_blocks = 1200; // reserved at a time, 10 minutes of blocks
+   uint64_t flush_seq = 1;                 // of the flush collecting the pending documents
+   std::deque<std::pair<uint64_t, block_ref>> handed_blocks; // the last block handed to each flush
+   fc::optional<block_ref> checkpoint_pending;
+   bool checkpoint_frozen = false;         // actions after the checkpoint are missing, only a replay writes them
+   boost::chrono::steady_clock::time_point checkpoint_written_at;
+   static const boost::chrono::seconds checkpoint_interval;
+
+   bool load_checkpoint();
+   void block_handed( uint32_t block_num, const block_id_type& id );
+   uint64_t written_seq();
+   void write_checkpoint();
+
+   // decoding of filtered actions, in order on the consume thread or spread over a worker pool
+   struct decode_job {
+      const chain::action*                    act = nullptr;
+      const chain::action_receipt*            receipt = nullptr; // of traced actions
+      int32_t                                 action_num = 0;
+      size_t                                  trx_index = 0;
+      size_t                                  contract = 0; // action_filter::contract_index
+      // resolved when the job is queued, so a preceding setabi in the stream is always seen
+      abi_serializer_cache::serializer_ptr    abis;
+      size_t                                  chunk = 0;
+      size_t                                  doc_offset = no_doc; // in the doc_buffer of the chunk
+   };
+   struct decode_trx {
+      std::shared_ptr<const void>              owner; // the transaction or trace holding the actions of the jobs
+      transaction_id_type                      id;
+      std::string                              id_str;
+      fc::time_point_sec                       expiration;
+      boost::chrono::steady_clock::time_point  queued_at;
+   };
+   struct decode_batch {
+      std::vector<decode_trx>                      trxs;
+      std::vector<decode_job>                      jobs;
+      std::vector<doc_buffer>                      docs; // one per chunk of jobs decoded together
+      std::atomic<size_t>                          remaining{0};
+   };
+   static constexpr size_t decode_batch_size = 64;
+   static constexpr size_t no_doc = std::numeric_limits<size_t>::max();
+   uint32_t decode_threads = 0;
+   boost::asio::io_service decode_ios;
+   fc::optional<boost::asio::io_service::work> decode_work;
+   boost::thread_group decode_thread_pool;
+   boost::mutex decode_mtx;
+   boost::condition_variable decode_cv;
+   std::unique_ptr<decode_batch> decode_current;
+   std::deque<std::unique_ptr<decode_batch>> decode_in_flight;
+
+   size_t add_decode_trx( std::shared_ptr<const void> owner, const transaction_id_type& id, fc::time_point_sec expiration,
+                          const boost::chrono::steady_clock::time_point& queued_at );
+   void add_decode_job( const chain::action& act, const chain::action_receipt* receipt, int32_t action_num, size_t trx_index,
+                        const account_name& contract );
+   void decode_jobs( decode_batch& batch, size_t begin, size_t end, size_t chunk );
+   void submit_decode_batch();
+   void collect_decoded( size_t max_in_flight );
+
+   // filtered actions wait per transaction until a block including the transaction is accepted and are
+   // stamped with its number and time; in irreversible-only mode they then wait per block until that
+   // block becomes irreversible
+   bool irreversible_only = false;
+   struct reversible_trx {
+      fc::time_point_sec                       expiration;
+      boost::chrono::steady_clock::time_point  queued_at;
+      doc_buffer                               docs;
+   };
+   struct reversible_block {
+      uint32_t                                 block_num = 0;
+      block_id_type                            block_id;
+      boost::chrono::steady_clock::time_point  queued_at = boost::chrono::steady_clock::time_point::max();
+      doc_buffer                               docs;
+   };
+   std::unordered_map<transaction_id_type, reversible_trx> reversible_trxs;
+   std::map<block_id_type, reversible_block> reversible_blocks; // every block accepted, in irreversible-only mode
    boost::thread consume_thread;
    boost::atomic<bool> done{false};
    boost::atomic<bool> startup{true};
    fc::optional<chain::chain_id_type> chain_id;
 
    void consume_blocks();
+   void add_block_docs( reversible_block& block );
+   void flush_filter_docs();
+
+   // aggregates of the written actions, upserted into filter_stats every stats_interval
+   std::unique_ptr<action_stats> stats;
+   boost::chrono::seconds stats_interval{0};
+   boost::chrono::steady_clock::time_point stats_flushed_at;
+   void flush_stats();
 
    static const account_name newaccount;
    static const account_name setabi;
 
    static const std::string accounts_col;
    static const std::string filter_col;
+   static const std::string stats_col;
+   static const std::string meta_col;
 };
 
 const account_name filter_mongo_db_plugin_impl::newaccount = "newaccount";
 const account_name filter_mongo_db_plugin_impl::setabi = "setabi";
 
+const fc::microseconds filter_mongo_db_plugin_impl::caught_up_block_age = fc::seconds( 30 );
+const fc::microseconds filter_mongo_db_plugin_impl::catch_up_block_age = fc::minutes( 5 );
+const boost::chrono::seconds filter_mongo_db_plugin_impl::unacknowledged_sync_interval = boost::chrono::seconds( 60 );
+
 const std::string filter_mongo_db_plugin_impl::filter_col = "filter";
 const std::string filter_mongo_db_plugin_impl::accounts_col = "accounts";
+const std::string filter_mongo_db_plugin_impl::stats_col = "filter_stats";
+const std::string filter_mongo_db_plugin_impl::meta_col = "filter_meta";
+const boost::chrono::seconds filter_mongo_db_plugin_impl::checkpoint_interval{ 1 };
 
-namespace {
+void filter_mongo_db_plugin_impl::accepted_transaction( const chain::transaction_metadata_ptr& t ) {
+   queued_event e;
+   e.kind = queued_event::transaction;
+   e.trx = t;
+   e.queued_at = boost::chrono::steady_clock::now();
+   on_event( std::move( e ));
+}
 
-template<typename Queue, typename Entry>
-void queue(boost::mutex& mtx, boost::condition_variable& condition, Queue& queue, const Entry& e, size_t queue_size) {
-   int sleep_time = 100;
-   size_t last_queue_size = 0;
-   boost::mutex::scoped_lock lock(mtx);
-   if (queue.size() > queue_size) {
-      lock.unlock();
-      condition.notify_one();
-      if (last_queue_size < queue.size()) {
-         sleep_time += 100;
-      } else {
-         sleep_time -= 100;
-         if (sleep_time < 0) sleep_time = 100;
-      }
-      last_queue_size = queue.size();
-      boost::this_thread::sleep_for(boost::chrono::milliseconds(sleep_time));
-      lock.lock();
-   }
-   queue.emplace_back(e);
-   lock.unlock();
-   condition.notify_one();
+void filter_mongo_db_plugin_impl::applied_transaction( const chain::transaction_trace_ptr& t ) {
+   queued_event e;
+   e.kind = queued_event::applied_transaction;
+   e.trace = t;
+   e.queued_at = boost::chrono::steady_clock::now();
+   on_event( std::move( e ));
 }
 
+void filter_mongo_db_plugin_impl::accepted_block( const chain::block_state_ptr& bs ) {
+   queued_event e;
+   e.kind = queued_event::accepted_block;
+   e.block = bs;
+   on_event( std::move( e ));
 }
 
-void filter_mongo_db_plugin_impl::accepted_transaction( const chain::transaction_metadata_ptr& t ) {
+void filter_mongo_db_plugin_impl::irreversible_block( const chain::block_state_ptr& bs ) {
+   queued_event e;
+   e.kind = queued_event::irreversible_block;
+   e.block = bs;
+   on_event( std::move( e ));
+}
+
+void filter_mongo_db_plugin_impl::on_event( queued_event&& ev ) {
    try {
       if( startup ) {
          // on startup we don't want to queue, instead push back on caller
-         process_accepted_transaction( t );
+         process_event( ev );
       } else {
-         queue( mtx, condition, transaction_metadata_queue, t, queue_size );
+         queue_event( std::move( ev ));
       }
    } catch (fc::exception& e) {
-      elog("FC Exception while accepted_transaction ${e}", ("e", e.to_string()));
+      elog("FC Exception while queueing controller event ${e}", ("e", e.to_string()));
    } catch (std::exception& e) {
-      elog("STD Exception while accepted_transaction ${e}", ("e", e.what()));
+      elog("STD Exception while queueing controller event ${e}", ("e", e.what()));
    } catch (...) {
-      elog("Unknown exception while accepted_transaction");
+      elog("Unknown exception while queueing controller event");
+   }
+}
+
+void filter_mongo_db_plugin_impl::queue_event( queued_event&& e ) {
+   auto& queue = *event_queue;
+   const bool droppable = e.kind == queued_event::transaction || e.kind == queued_event::applied_transaction;
+   const auto policy = (queue_overflow == overflow_policy::drop && !droppable) ?
+                       overflow_policy::block : queue_overflow;
+   switch( policy ) {
+      case overflow_policy::block: {
+         boost::chrono::microseconds blocked{0};
+         if( !queue.push( std::move( e ), blocked )) {
+            ++dropped_transactions; // consume thread is gone
+         }
+         if( blocked.count() > 0 ) {
+            producer_blocked_us += blocked.count();
+         }
+         break;
+      }
+      case overflow_policy::drop:
+         if( !queue.try_push( std::move( e ))) {
+            ++dropped_transactions;
+         }
+         break;
+      case overflow_policy::spill: {
+         // once anything is spilled keep spilling until the consumer took it, to preserve order
+         boost::mutex::scoped_lock lock( spill_mtx );
+         if( event_spill.empty() && queue.try_push( std::move( e ))) {
+            break;
+         }
+         if( event_spill.size() >= spill_max_events ) {
+            const auto start = boost::chrono::steady_clock::now();
+            while( event_spill.size() >= spill_max_events && !done ) {
+               queue.notify_consumer();
+               spill_cv.wait( lock );
+            }
+            producer_blocked_us += boost::chrono::duration_cast<boost::chrono::microseconds>(
+                  boost::chrono::steady_clock::now() - start ).count();
+         }
+         event_spill.emplace_back( std::move( e ));
+         spill_size = event_spill.size();
+         lock.unlock();
+         ++spilled_events;
+         queue.notify_consumer();
+         break;
+      }
    }
 }
 
+void filter_mongo_db_plugin_impl::process_event( const queued_event& e ) {
+   switch( e.kind ) {
+      case queued_event::transaction:
+         metrics.local().queue_latency_us.record( boost::chrono::duration_cast<boost::chrono::microseconds>(
+               boost::chrono::steady_clock::now() - e.queued_at ).count() );
+         process_accepted_transaction( e.trx, e.queued_at );
+         break;
+      case queued_event::applied_transaction:
+         metrics.local().queue_latency_us.record( boost::chrono::duration_cast<boost::chrono::microseconds>(
+               boost::chrono::steady_clock::now() - e.queued_at ).count() );
+         process_applied_transaction( e.trace, e.queued_at );
+         break;
+      case queued_event::accepted_block:
+         process_accepted_block( e.block );
+         break;
+      case queued_event::irreversible_block:
+         process_irreversible_block( e.block );
+         break;
+   }
+}
 
 void filter_mongo_db_plugin_impl::consume_blocks() {
+   auto& queue = *event_queue;
    try {
+      std::deque<queued_event> spilled;
+      queued_event e;
       while (true) {
-         boost::mutex::scoped_lock lock(mtx);
-         while ( transaction_metadata_queue.empty() &&
-                 !done ) {
-            condition.wait(lock);
+         auto deadline = pending_filter_count == 0 ?
+               boost::chrono::steady_clock::now() + boost::chrono::seconds( 1 ) :
+               pending_since + batch_max_latency;
+         if( registry.pending() > 0 ) {
+            deadline = std::min( deadline, accounts_pending_since + batch_max_latency );
          }
+         queue.wait_until( deadline, [this]() { return spill_size.load() > 0 || done; } );
 
-         // capture for processing
-         size_t transaction_metadata_size = transaction_metadata_queue.size();
-         if (transaction_metadata_size > 0) {
-            transaction_metadata_process_queue = move(transaction_metadata_queue);
-            transaction_metadata_queue.clear();
+         // warn if queue size greater than 75%
+         const size_t queue_depth = queue.size() + spill_size.load();
+         if( queue_depth > (queue.capacity() * 0.75) ) {
+            wlog("queue size: ${q}, producer blocked ${b} ms, dropped ${d}, spilled ${s}",
+                 ("q", queue_depth)("b", producer_blocked_us.load() / 1000)
+                 ("d", dropped_transactions.load())("s", spilled_events.load()));
+         } else if (done) {
+            ilog("draining queue, size: ${q}", ("q", queue_depth ));
          }
 
-         lock.unlock();
+         // process events, at most one ring worth per round so batches still time out
+         for( size_t n = queue.capacity(); n > 0 && queue.try_pop( e ); --n ) {
+            process_event( e );
+         }
+         e = queued_event();
+
+         // spilled events are newer than anything left in an empty ring
+         if( queue.empty() && spill_size.load() > 0 ) {
+            {
+               boost::mutex::scoped_lock lock( spill_mtx );
+               spilled.swap( event_spill );
+               spill_size = 0;
+            }
+            spill_cv.notify_all();
+            for( const auto& se : spilled ) {
+               process_event( se );
+            }
+            spilled.clear();
+         }
 
-         // warn if queue size greater than 75%
+         // hand decoded actions to the writer, wait for the workers when there is nothing else to do
+         submit_decode_batch();
+         collect_decoded( queue.empty() ? 0 : 2 * decode_threads + 1 );
 
-         if( transaction_metadata_size > (queue_size * 0.75) ) {
-            //wlog("queue size: ${q}", ("q", transaction_metadata_size + transaction_trace_size + block_state_size + irreversible_block_size));
-            wlog("queue size: ${q}", ("q", transaction_metadata_size ));
-         } else if (done) {
-            ilog("draining queue, size: ${q}", ("q", transaction_metadata_size ));
+         if( pending_filter_count > 0 &&
+             (done || boost::chrono::steady_clock::now() - pending_since >= batch_max_latency) ) {
+            flush_filter_docs();
+         }
+         if( registry.pending() > 0 &&
+             (done || boost::chrono::steady_clock::now() - accounts_pending_since >= batch_max_latency) ) {
+            flush_accounts();
+         }
+         if( stats && (done || boost::chrono::steady_clock::now() - stats_flushed_at >= stats_interval) ) {
+            flush_stats();
+         }
+         if( checkpoint_enabled && boost::chrono::steady_clock::now() - checkpoint_written_at >= checkpoint_interval ) {
+            write_checkpoint();
          }
 
-         // process transactions
-         while (!transaction_metadata_process_queue.empty()) {
-            const auto& t = transaction_metadata_process_queue.front();
-            process_accepted_transaction(t);
-            transaction_metadata_process_queue.pop_front();
+         if( metrics_log_interval.count() > 0 &&
+             boost::chrono::steady_clock::now() - metrics_logged_at >= metrics_log_interval ) {
+            log_metrics();
          }
 
-        if( transaction_metadata_size == 0 &&
-             done ) {
+         if( done && queue.empty() && spill_size.load() == 0 ) {
+            flush_filter_docs();
+            flush_accounts();
+            if( stats ) {
+               flush_stats();
+            }
             break;
          }
       }
@@ -190,299 +654,1052 @@ void filter_mongo_db_plugin_impl::consume_blocks() {
    } catch (...) {
       elog("Unknown exception while consuming block");
    }
+   // never leave the producer blocked on a consumer that is gone
+   queue.close();
 }
 
 namespace {
 
-   auto find_account(mongocxx::collection& accounts, const account_name& name) {
-      using bsoncxx::builder::basic::make_document;
-      using bsoncxx::builder::basic::kvp;
-      return accounts.find_one( make_document( kvp( "name", name.to_string())));
-   }
-
    auto find_transaction(mongocxx::collection& trans, const string& id) {
       using bsoncxx::builder::basic::make_document;
       using bsoncxx::builder::basic::kvp;
       return trans.find_one( make_document( kvp( "trx_id", id )));
    }
 
+}
 
-   optional<abi_serializer> get_abi_serializer( account_name n, mongocxx::collection& accounts ) {
-      using bsoncxx::builder::basic::kvp;
-      using bsoncxx::builder::basic::make_document;
-      if( n.good()) {
+abi_serializer_cache::serializer_ptr filter_mongo_db_plugin_impl::get_abi_serializer( const account_name& n ) {
+   abi_serializer_cache::serializer_ptr result;
+   if( !n.good() )
+      return result;
+   if( abi_cache.find( n, result )) {
+      metrics.local().abi_hits.add();
+      return result;
+   }
+   metrics.local().abi_misses.add();
+
+   // the registry holds the current abi of every tracked account, so a miss never goes to MongoDB
+   if( auto abi = registry.abi( n )) {
+      try {
+         result = std::make_shared<abi_serializer>( *abi );
+      } catch (...) {
+         ilog( "Unable to create abi_serializer for ${n}", ( "n", n ));
+      }
+   }
+   abi_cache.put( n, result );
+   return result;
+}
+
+template<typename T>
+fc::variant filter_mongo_db_plugin_impl::to_variant_with_abi( const T& obj ) {
+   fc::variant pretty_output;
+   abi_serializer::to_variant( obj, pretty_output, [&]( account_name n ) {
+      auto abis = get_abi_serializer( n );
+      return abis ? optional<abi_serializer>( *abis ) : optional<abi_serializer>();
+   } );
+   return pretty_output;
+}
+
+void filter_mongo_db_plugin_impl::update_account( const chain::action& act ) {
+   if (act.account != chain::config::system_account_name)
+      return;
+
+   try {
+      const size_t pending = registry.pending();
+      if( act.name == newaccount ) {
+         auto newaccount = act.data_as<chain::newaccount>();
+         registry.created( newaccount.name, fc::time_point::now() );
+
+      } else if( act.name == setabi ) {
+         auto setabi = act.data_as<chain::setabi>();
+         account_registry::abi_ptr abi;
          try {
-            auto account = accounts.find_one( make_document( kvp("name", n.to_string())) );
-            if(account) {
-               auto view = account->view();
-               abi_def abi;
-               if( view.find( "abi" ) != view.end()) {
-                  try {
-                     abi = fc::json::from_string( bsoncxx::to_json( view["abi"].get_document())).as<abi_def>();
-                  } catch (...) {
-                     ilog( "Unable to convert account abi to abi_def for ${n}", ( "n", n ));
-                     return optional<abi_serializer>();
-                  }
-                  return abi_serializer( abi );
-               }
-            }
-         } FC_CAPTURE_AND_LOG((n))
+            abi = std::make_shared<abi_def>( fc::raw::unpack<chain::abi_def>( setabi.abi ));
+         } catch( fc::exception& e ) {
+            // if unable to unpack abi_def then the account has no abi to decode its actions with
+            // users are not required to use abi_def as their abi
+         }
+         registry.set_abi( setabi.account, std::move( abi ), fc::time_point::now() );
+         // built again from the registry on the next lookup
+         abi_cache.erase( setabi.account );
+      }
+      if( pending == 0 && registry.pending() > 0 ) {
+         accounts_pending_since = boost::chrono::steady_clock::now();
       }
-      return optional<abi_serializer>();
+   } catch( fc::exception& e ) {
+      // if unable to unpack native type, skip account creation
    }
+}
 
-   template<typename T>
-   fc::variant to_variant_with_abi( const T& obj, mongocxx::collection& accounts ) {
-      fc::variant pretty_output;
-      abi_serializer::to_variant( obj, pretty_output, [&]( account_name n ) { return get_abi_serializer( n, accounts ); } );
-      return pretty_output;
+void filter_mongo_db_plugin_impl::flush_accounts() {
+   if( registry.pending() == 0 )
+      return;
+   if( !registry.flush( accounts )) {
+      metrics.local().mongo_errors.add();
+      // kept changes are tried again after the next batch latency
+      accounts_pending_since = boost::chrono::steady_clock::now();
    }
+}
 
+void filter_mongo_db_plugin_impl::track_account( const account_name& n ) {
+   using bsoncxx::builder::basic::make_document;
+   using bsoncxx::builder::basic::kvp;
 
-   void update_account(mongocxx::collection& accounts, const chain::action& act) {
-      using bsoncxx::builder::basic::kvp;
-      using bsoncxx::builder::basic::make_document;
-      using namespace bsoncxx::types;
+   if( registry.tracked( n ))
+      return;
+   // from now on setabi keeps its abi in memory, the current one is read once from the accounts collection
+   registry.track( n );
+   if( !mongo_conn )
+      return;
+   flush_accounts();
+   try {
+      mongocxx::options::find opts;
+      opts.projection( make_document( kvp( "_id", 0 ), kvp( "abi", 1 )));
+      auto doc = accounts.find_one( make_document( kvp( "name", n.to_string() ),
+                                                   kvp( "abi", make_document( kvp( "$exists", true )))), opts );
+      if( doc ) {
+         registry.load( n, std::make_shared<abi_def>( from_bson( doc->view()["abi"].get_document().value ).as<abi_def>() ));
+      }
+   } catch( fc::exception& e ) {
+      ilog( "Unable to load the abi of ${n}: ${e}", ("n", n)("e", e.to_string()));
+   } catch( std::exception& e ) {
+      metrics.local().mongo_errors.add();
+      ilog( "Unable to load the abi of ${n}: ${e}", ("n", n)("e", e.what()));
+   }
+   // a lookup before tracking cached a missing serializer
+   abi_cache.erase( n );
+}
 
-      if (act.account != chain::config::system_account_name)
-         return;
+void filter_mongo_db_plugin_impl::process_accepted_transaction( const chain::transaction_metadata_ptr& t,
+                                                                const boost::chrono::steady_clock::time_point& queued_at ) {
+   try {
+      // always call since we need to capture setabi on accounts even if not storing transactions
+      _process_accepted_transaction( t, queued_at );
+   } catch (fc::exception& e) {
+      elog("FC Exception while processing accepted transaction metadata: ${e}", ("e", e.to_detail_string()));
+   } catch (std::exception& e) {
+      elog("STD Exception while processing accepted tranasction metadata: ${e}", ("e", e.what()));
+   } catch (...) {
+      elog("Unknown exception while processing accepted transaction metadata");
+   }
+}
 
-      try {
-         if( act.name == filter_mongo_db_plugin_impl::newaccount ) {
-            auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
-                  std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()} );
-            auto newaccount = act.data_as<chain::newaccount>();
-
-            // create new account
-            if( !accounts.insert_one( make_document( kvp( "name", newaccount.name.to_string()),
-                                                     kvp( "createdAt", b_date{now} )))) {
-               elog( "Failed to insert account ${n}", ("n", newaccount.name));
-            }
 
-         } else if( act.name == filter_mongo_db_plugin_impl::setabi ) {
-            auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
-                  std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()} );
-            auto setabi = act.data_as<chain::setabi>();
-            auto from_account = find_account( accounts, setabi.account );
-            if( !from_account ) {
-               if( !accounts.insert_one( make_document( kvp( "name", setabi.account.to_string()),
-                                                        kvp( "createdAt", b_date{now} )))) {
-                  elog( "Failed to insert account ${n}", ("n", setabi.account));
-               }
-               from_account = find_account( accounts, setabi.account );
+void filter_mongo_db_plugin_impl::process_accepted_block( const chain::block_state_ptr& bs ) {
+   try {
+      const fc::time_point block_time = bs->header.timestamp.to_time_point();
+      const fc::time_point now = fc::time_point::now();
+      if( catch_up_enabled ) {
+         const bool catch_up = catching_up ? block_time < now - caught_up_block_age : block_time < now - catch_up_block_age;
+         if( catch_up != catching_up ) {
+            // pending documents go out with the settings they were collected under
+            submit_decode_batch();
+            collect_decoded( 0 );
+            flush_filter_docs();
+            catching_up = catch_up;
+            if( catch_up ) {
+               ilog( "block ${n} is ${a} s old, writing in catch-up mode", ("n", bs->block_num)("a", ( now - block_time ).to_seconds()) );
+            } else {
+               ilog( "caught up at block ${n}, writing with the default write concern again", ("n", bs->block_num) );
             }
-            if( from_account ) {
-               try {
-                  const abi_def& abi_def = fc::raw::unpack<chain::abi_def>( setabi.abi );
-                  const string json_str = fc::json::to_string( abi_def );
-
-                  auto update_from = make_document(
-                        kvp( "$set", make_document( kvp( "abi", bsoncxx::from_json( json_str )),
-                                                    kvp( "updatedAt", b_date{now} ))));
-
-                  if( !accounts.update_one( make_document( kvp( "_id", from_account->view()["_id"].get_oid())), update_from.view()) ) {
-                     elog( "Failed to udpdate account ${n}", ("n", setabi.account));
-                  }
-               } catch( fc::exception& e ) {
-                  // if unable to unpack abi_def then just don't save the abi
-                  // users are not required to use abi_def as their abi
-               }
+         }
+      }
+      if( indexes_deferred && block_time >= now - caught_up_block_age ) {
+         indexes_deferred = false;
+         ilog( "caught up at block ${n}, building indexes in the background", ("n", bs->block_num) );
+         index_thread = boost::thread( [this] {
+            try {
+               auto client = mongo_pool->acquire();
+               create_indexes( *client, true );
+               ilog( "indexes built" );
+            } catch( std::exception& e ) {
+               elog( "Unable to build indexes: ${e}", ("e", e.what()));
             }
+         } );
+      }
+      seen_trxs.advance( fc::time_point_sec( block_time ));
+      seen_traces.advance( fc::time_point_sec( block_time ));
+      head_block_time = fc::time_point_sec( block_time );
+
+      // the transactions of the next block are the first ones written
+      const bool reached = bs->block_num + 1 >= start_block_num;
+      if( reached && !start_block_reached ) {
+         ilog( "block ${n} accepted, writing filtered actions from block ${s} on", ("n", bs->block_num)("s", start_block_num) );
+      }
+      start_block_reached = reached;
+      if( resume_block && bs->block_num >= resume_block->block_num ) {
+         if( bs->block_num == resume_block->block_num && bs->id != resume_block->block_id ) {
+            wlog( "block ${n} is ${id}, the checkpoint was written for ${c}; filtered actions of that forked out block may be left",
+                  ("n", bs->block_num)("id", bs->id)("c", resume_block->block_id) );
+         } else if( bs->block_num > resume_block->block_num + 1 ) {
+            // the checkpoint stays where it is, so a replay still resumes after it
+            checkpoint_frozen = true;
+            elog( "first block accepted after the checkpoint at block ${c} is ${n}, the filtered actions in between are missing;"
+                  " the checkpoint is kept, restart with --replay-blockchain to write them",
+                  ("c", resume_block->block_num)("n", bs->block_num) );
          }
-      } catch( fc::exception& e ) {
-         // if unable to unpack native type, skip account creation
+         resume_block.reset();
       }
-   }
 
-   void add_data(bsoncxx::builder::basic::document& act_doc, mongocxx::collection& accounts, const chain::action& act) {
+      // route the documents of everything queued so far
+      submit_decode_batch();
+      collect_decoded( 0 );
+
+      using namespace bsoncxx::types;
       using bsoncxx::builder::basic::kvp;
-      using bsoncxx::builder::basic::make_document;
-      try {
-         if( act.account == chain::config::system_account_name ) {
-            if( act.name == filter_mongo_db_plugin_impl::newaccount ) {
-               auto newaccount = act.data_as<chain::newaccount>();
-               try {
-                  auto json = fc::json::to_string( newaccount );
-                  const auto& value = bsoncxx::from_json( json );
-                  act_doc.append( kvp( "data", value ));
-                  return;
-               } catch (...) {
-                  ilog( "Unable to convert action newaccount to json for ${n}", ( "n", newaccount.name.to_string() ));
-               }
-            } else if( act.name == filter_mongo_db_plugin_impl::setabi ) {
-               auto setabi = act.data_as<chain::setabi>();
-               try {
-                  const abi_def& abi_def = fc::raw::unpack<chain::abi_def>( setabi.abi );
-                  const string json_str = fc::json::to_string( abi_def );
-
-                  // the original keys from document 'view' are kept, "data" here is not replaced by "data" of add_data
-                  act_doc.append(
-                        kvp( "data", make_document( kvp( "account", setabi.account.to_string()),
-                                                    kvp( "abi_def", bsoncxx::from_json( json_str )))));
-                  return;
-               } catch( fc::exception& e ) {
-                  ilog( "Unable to convert action abi_def to json for ${n}", ( "n", setabi.account.to_string() ));
-               }
-            }
+      // the fields every document of the block gets, appended to each as it is copied into the block
+      const auto stamp = bsoncxx::builder::basic::make_document(
+            kvp( "block_num", b_int32{ static_cast<int32_t>( bs->block_num ) } ),
+            kvp( "block_time", b_date{ std::chrono::milliseconds{ block_time.time_since_epoch().count() / 1000 }} ));
+
+      reversible_block rb;
+      rb.block_num = bs->block_num;
+      rb.block_id = bs->id;
+      const bool written = bs->block_num >= start_block_num;
+      for( const auto& receipt : bs->block->transactions ) {
+         const transaction_id_type id = receipt.trx.contains<transaction_id_type>() ?
+                                        receipt.trx.get<transaction_id_type>() :
+                                        receipt.trx.get<packed_transaction>().id();
+         seen_trxs.erase( id );
+         seen_traces.erase( id );
+         auto itr = reversible_trxs.find( id );
+         if( itr != reversible_trxs.end() && !written ) {
+            reversible_trxs.erase( itr );
+         } else if( itr != reversible_trxs.end() ) {
+            rb.queued_at = std::min( rb.queued_at, itr->second.queued_at );
+            itr->second.docs.for_each( [&]( const bsoncxx::document::view& doc ) {
+               rb.docs.append( doc, stamp.view() );
+            } );
+            reversible_trxs.erase( itr );
          }
-         auto account = find_account( accounts, act.account );
-         if (account) {
-            auto from_account = *account;
-            abi_def abi;
-            if( from_account.view().find( "abi" ) != from_account.view().end()) {
-               try {
-                  abi = fc::json::from_string( bsoncxx::to_json( from_account.view()["abi"].get_document())).as<abi_def>();
-               } catch( ... ) {
-                  ilog( "Unable to convert account abi to abi_def for ${s}::${n}", ("s", act.account)( "n", act.name ));
-               }
-            }
-            string json;
-            try {
-               abi_serializer abis;
-               abis.set_abi( abi );
-               auto v = abis.binary_to_variant( abis.get_action_type( act.name ), act.data );
-               json = fc::json::to_string( v );
-
-               const auto& value = bsoncxx::from_json( json );
-               act_doc.append( kvp( "data", value ));
-               return;
-            } catch( std::exception& e ) {
-               elog( "Unable to convert EOS JSON to MongoDB JSON: ${e}", ("e", e.what()));
-               elog( "  EOS JSON: ${j}", ("j", json));
-            }
+      }
+
+      // transactions that expired without making it into a block never will
+      for( auto it = reversible_trxs.begin(); it != reversible_trxs.end(); ) {
+         if( it->second.expiration < fc::time_point_sec( block_time )) {
+            it = reversible_trxs.erase( it );
+         } else {
+            ++it;
          }
-      } catch (fc::exception& e) {
-         if( act.name != "onblock" ) { // onblock not in original eosio.system contract abi
-            dlog( "Unable to convert action.data to ABI: ${s}::${n}, what: ${e}",
-                  ("s", act.account)( "n", act.name )( "e", e.to_detail_string()));
+      }
+
+      if( irreversible_only ) {
+         // kept without documents too, an irreversible block missing here was accepted before the start
+         reversible_blocks[bs->id] = std::move( rb );
+      } else {
+         add_block_docs( rb );
+      }
+   } catch (fc::exception& e) {
+      elog("FC Exception while processing accepted block: ${e}", ("e", e.to_detail_string()));
+   } catch (std::exception& e) {
+      elog("STD Exception while processing accepted block: ${e}", ("e", e.what()));
+   } catch (...) {
+      elog("Unknown exception while processing accepted block");
+   }
+}
+
+void filter_mongo_db_plugin_impl::process_irreversible_block( const chain::block_state_ptr& bs ) {
+   try {
+      auto itr = reversible_blocks.find( bs->id );
+      if( itr != reversible_blocks.end() ) {
+         add_block_docs( itr->second );
+      } else {
+         // its transactions were applied before the start and their buffers discarded at the last shutdown
+         if( checkpoint_enabled && !checkpoint_frozen && bs->block_num >= start_block_num ) {
+            checkpoint_frozen = true;
+            elog( "block ${n} became irreversible without being accepted since the start, its filtered actions are missing;"
+                  " the checkpoint is kept, restart with --replay-blockchain to write them", ("n", bs->block_num) );
+         }
+         reversible_block empty;
+         empty.block_num = bs->block_num;
+         empty.block_id = bs->id;
+         add_block_docs( empty );
+      }
+
+      // any other buffered block at or below this height was forked out
+      for( auto it = reversible_blocks.begin(); it != reversible_blocks.end(); ) {
+         if( it->second.block_num <= bs->block_num ) {
+            it = reversible_blocks.erase( it );
+         } else {
+            ++it;
          }
-      } catch (std::exception& e) {
-         ilog( "Unable to convert action.data to ABI: ${s}::${n}, std what: ${e}",
-               ("s", act.account)( "n", act.name )( "e", e.what()));
+      }
+   } catch (fc::exception& e) {
+      elog("FC Exception while processing irreversible block: ${e}", ("e", e.to_detail_string()));
+   } catch (std::exception& e) {
+      elog("STD Exception while processing irreversible block: ${e}", ("e", e.what()));
+   } catch (...) {
+      elog("Unknown exception while processing irreversible block");
+   }
+}
+
+void filter_mongo_db_plugin_impl::_process_accepted_transaction( const chain::transaction_metadata_ptr& t,
+                                                                 const boost::chrono::steady_clock::time_point& queued_at ) {
+   const auto& trx = t->trx;
+   auto& m = metrics.local();
+   m.transactions.add();
+
+   // the controller signals a transaction again when it is re-applied after a switch and when it is in a block
+   if( seen_trxs.contains( t->id )) {
+      m.duplicate_transactions.add();
+      return;
+   }
+
+   auto update_account_of = [&]( const chain::action& act ) {
+      try {
+         update_account( act );
       } catch (...) {
-         ilog( "Unable to convert action.data to ABI: ${s}::${n}, unknown exception",
-               ("s", act.account)( "n", act.name ));
+         ilog( "Unable to update account for ${s}::${n}", ("s", act.account)( "n", act.name ));
+      }
+   };
+
+   // most transactions match no filter, for those only keep account and abi bookkeeping
+   const bool filtered = start_block_reached && !inline_actions &&
+         std::any_of( trx.actions.begin(), trx.actions.end(), [&]( const chain::action& act ) { return filter.match( act ); } );
+   if( !filtered ) {
+      m.fast_path_transactions.add();
+      for( const auto& act : trx.actions ) {
+         if( act.account == chain::config::system_account_name && ( act.name == newaccount || act.name == setabi )) {
+            seen_trxs.insert( t->id, trx.expiration );
+         }
+         update_account_of( act );
       }
-      // if anything went wrong just store raw hex_data
-      act_doc.append( kvp( "hex_data", fc::variant( act.data ).as_string()));
+      return;
    }
+   seen_trxs.insert( t->id, trx.expiration );
 
+   const size_t trx_index = add_decode_trx( t, t->id, trx.expiration, queued_at );
+   int32_t act_num = 0;
+   for( const auto& act : trx.actions ) {
+      update_account_of( act );
+      if( filter.match( act )) {
+         add_decode_job( act, nullptr, act_num, trx_index, act.account );
+      }
+      ++act_num;
+   }
+
+   if( decode_current->jobs.size() >= decode_batch_size ) {
+      submit_decode_batch();
+   }
 }
 
-void filter_mongo_db_plugin_impl::process_accepted_transaction( const chain::transaction_metadata_ptr& t ) {
+void filter_mongo_db_plugin_impl::process_applied_transaction( const chain::transaction_trace_ptr& t,
+                                                               const boost::chrono::steady_clock::time_point& queued_at ) {
    try {
-      // always call since we need to capture setabi on accounts even if not storing transactions
-      _process_accepted_transaction(t);
+      // failed transactions have no receipt and never make it into a block
+      if( !start_block_reached || !t->receipt || t->except )
+         return;
+
+      // an action is emitted where it runs in its own contract, a notification where a filter contract receives
+      // it and its name and actors match the rules of that receiver; the sender of a notification need not be a
+      // filter contract, its abi is tracked as well to decode it
+      std::vector<std::pair<const chain::action_trace*, account_name>> matched;
+      std::function<void( const chain::action_trace& )> walk = [&]( const chain::action_trace& at ) {
+         if( at.receipt.receiver == at.act.account ) {
+            if( filter.match( at.act ))
+               matched.emplace_back( &at, at.act.account );
+         } else if( filter.match( at.receipt.receiver, at.act )) {
+            if( raw_data != raw_data_mode::only )
+               track_account( at.act.account );
+            matched.emplace_back( &at, at.receipt.receiver );
+         }
+         for( const auto& inline_trace : at.inline_traces ) {
+            walk( inline_trace );
+         }
+      };
+      for( const auto& at : t->action_traces ) {
+         walk( at );
+      }
+      // the expiration is not in the trace, it is at most the maximum lifetime past the head block
+      const fc::time_point_sec expiration = head_block_time + chain::config::default_max_trx_lifetime;
+      if( matched.empty() ) {
+         // drops the documents of an earlier trace of the transaction
+         if( !seen_traces.enabled() || seen_traces.contains( t->id )) {
+            add_decode_trx( t, t->id, expiration, queued_at );
+         }
+         return;
+      }
+
+      seen_traces.insert( t->id, expiration );
+      const size_t trx_index = add_decode_trx( t, t->id, expiration, queued_at );
+      // numbered in execution order, which the global sequence follows too
+      int32_t act_num = 0;
+      for( const auto& m : matched ) {
+         add_decode_job( m.first->act, &m.first->receipt, act_num++, trx_index, m.second );
+      }
+
+      if( decode_current->jobs.size() >= decode_batch_size ) {
+         submit_decode_batch();
+      }
    } catch (fc::exception& e) {
-      elog("FC Exception while processing accepted transaction metadata: ${e}", ("e", e.to_detail_string()));
+      elog("FC Exception while processing applied transaction trace: ${e}", ("e", e.to_detail_string()));
    } catch (std::exception& e) {
-      elog("STD Exception while processing accepted tranasction metadata: ${e}", ("e", e.what()));
+      elog("STD Exception while processing applied transaction trace: ${e}", ("e", e.what()));
    } catch (...) {
-      elog("Unknown exception while processing accepted transaction metadata");
+      elog("Unknown exception while processing applied transaction trace");
    }
 }
 
+size_t filter_mongo_db_plugin_impl::add_decode_trx( std::shared_ptr<const void> owner, const transaction_id_type& id,
+                                                    fc::time_point_sec expiration,
+                                                    const boost::chrono::steady_clock::time_point& queued_at ) {
+   if( !decode_current ) {
+      decode_current.reset( new decode_batch );
+   }
+   auto& trxs = decode_current->trxs;
+   trxs.emplace_back( decode_trx{ std::move( owner ), id, id.str(), expiration, queued_at } );
+   return trxs.size() - 1;
+}
 
-void filter_mongo_db_plugin_impl::_process_accepted_transaction( const chain::transaction_metadata_ptr& t ) {
-   using namespace bsoncxx::types;
-   using bsoncxx::builder::basic::kvp;
-   using bsoncxx::builder::basic::make_document;
-   using bsoncxx::builder::basic::make_array;
-   namespace bbb = bsoncxx::builder::basic;
+void filter_mongo_db_plugin_impl::add_decode_job( const chain::action& act, const chain::action_receipt* receipt, int32_t action_num,
+                                                  size_t trx_index, const account_name& contract ) {
+   auto& jobs = decode_current->jobs;
+   jobs.emplace_back();
+   auto& job = jobs.back();
+   job.act = &act;
+   job.receipt = receipt;
+   job.action_num = action_num;
+   job.trx_index = trx_index;
+   job.contract = filter.contract_index( contract );
+   if( raw_data != raw_data_mode::only ) {
+      job.abis = get_abi_serializer( act.account );
+   }
+}
+
+void filter_mongo_db_plugin_impl::decode_jobs( decode_batch& batch, size_t begin, size_t end, size_t chunk ) {
+   // reused for every action the thread decodes, so its buffers and names are only allocated once
+   static thread_local action_doc_builder builder;
+   auto& m = metrics.local();
+   auto& out = batch.docs[chunk];
+   for( size_t i = begin; i < end; ++i ) {
+      auto& job = batch.jobs[i];
+      const auto start = boost::chrono::steady_clock::now();
+      job.chunk = chunk;
+      try {
+         const size_t offset = out.byte_size();
+         builder.build( *job.act, job.action_num, batch.trxs[job.trx_index].id_str, job.abis, raw_data, out, job.receipt );
+         job.doc_offset = offset;
+      } catch( fc::exception& e ) {
+         elog( "Unable to build action document for ${s}::${n}: ${e}", ("s", job.act->account)("n", job.act->name)("e", e.to_string()));
+      } catch( std::exception& e ) {
+         elog( "Unable to build action document for ${s}::${n}: ${e}", ("s", job.act->account)("n", job.act->name)("e", e.what()));
+      }
+      auto& stats = m.contracts[job.contract];
+      stats.actions.add();
+      stats.decode_ns.add( boost::chrono::duration_cast<boost::chrono::nanoseconds>( boost::chrono::steady_clock::now() - start ).count() );
+      if( job.doc_offset != no_doc ) {
+         m.actions.add();
+      } else {
+         m.decode_errors.add();
+      }
+   }
+}
 
+void filter_mongo_db_plugin_impl::submit_decode_batch() {
+   if( !decode_current || decode_current->trxs.empty() )
+      return;
+
+   decode_batch* batch = decode_current.get();
+   const size_t n = batch->jobs.size();
+   if( decode_threads == 0 ) {
+      batch->docs.resize( 1 );
+      decode_jobs( *batch, 0, n, 0 );
+   } else {
+      const size_t chunk = std::max<size_t>( 1, n / decode_threads );
+      batch->remaining = (n + chunk - 1) / chunk;
+      batch->docs.resize( batch->remaining );
+      for( size_t begin = 0; begin < n; begin += chunk ) {
+         const size_t end = std::min( n, begin + chunk );
+         decode_ios.post( [this, batch, begin, end, chunk]() {
+            decode_jobs( *batch, begin, end, begin / chunk );
+            if( --batch->remaining == 0 ) {
+               boost::mutex::scoped_lock lock( decode_mtx );
+               decode_cv.notify_all();
+            }
+         } );
+      }
+   }
+   decode_in_flight.emplace_back( std::move( decode_current ));
 
-   accounts = mongo_conn[db_name][accounts_col];
-   auto filter = mongo_conn[db_name][filter_col];
-   auto trans_doc = bsoncxx::builder::basic::document{};
+   // bound the number of batches the workers may run ahead of the writer
+   collect_decoded( 2 * decode_threads + 1 );
+}
 
-   auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
-         std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()});
+void filter_mongo_db_plugin_impl::collect_decoded( size_t max_in_flight ) {
+   // batches are handed to the writer strictly in the order they were queued
+   while( !decode_in_flight.empty() ) {
+      auto& batch = *decode_in_flight.front();
+      if( batch.remaining.load() != 0 ) {
+         if( decode_in_flight.size() <= max_in_flight )
+            break;
+         boost::mutex::scoped_lock lock( decode_mtx );
+         decode_cv.wait( lock, [&batch]() { return batch.remaining.load() == 0; } );
+      }
+      const auto now = boost::chrono::steady_clock::now();
+      for( const auto& trx : batch.trxs ) {
+         metrics.local().decode_latency_us.record( boost::chrono::duration_cast<boost::chrono::microseconds>( now - trx.queued_at ).count() );
+      }
+      // a transaction signalled again, applied speculatively and then in its block, replaces its documents;
+      // the jobs are queued in the order of their transactions
+      size_t j = 0;
+      for( size_t trx_index = 0; trx_index < batch.trxs.size(); ++trx_index ) {
+         const auto& trx = batch.trxs[trx_index];
+         auto& rt = reversible_trxs[trx.id];
+         rt.expiration = trx.expiration;
+         rt.queued_at = trx.queued_at;
+         rt.docs.clear();
+         for( ; j < batch.jobs.size() && batch.jobs[j].trx_index == trx_index; ++j ) {
+            const auto& job = batch.jobs[j];
+            if( job.doc_offset != no_doc ) {
+               rt.docs.append( batch.docs[job.chunk].at( job.doc_offset ));
+            }
+         }
+         if( rt.docs.empty() ) {
+            reversible_trxs.erase( trx.id );
+         }
+      }
+      decode_in_flight.pop_front();
+   }
+}
 
-   const auto trx_id = t->id;
-   const auto trx_id_str = trx_id.str();
-   const auto& trx = t->trx;
-   const chain::transaction_header& trx_header = trx;
+size_t filter_mongo_db_plugin_impl::partition_of( const bsoncxx::document::view& doc )const {
+   if( writers.size() <= 1 )
+      return 0;
+   auto key = doc[writer_partition == partition_key::account ? "account" : "trx_id"];
+   if( !key || key.type() != bsoncxx::type::k_utf8 )
+      return 0;
+   auto value = key.get_utf8().value;
+   return boost::hash_range( value.data(), value.data() + value.size() ) % writers.size();
+}
 
-   bool actions_to_write = false;
-   bool filter_to_write = false;
-   mongocxx::options::bulk_write bulk_opts;
-   bulk_opts.ordered(false);
+void filter_mongo_db_plugin_impl::add_block_docs( reversible_block& block ) {
+   // before any of its documents can reach a writer
+   block_handed( block.block_num, block.block_id );
+   if( block.docs.empty() )
+      return;
+
+   if( stats ) {
+      block.docs.for_each( [this]( const bsoncxx::document::view& doc ) { stats->add( doc ); } );
+   }
+   if( pending_filter_count == 0 ) {
+      pending_since = boost::chrono::steady_clock::now();
+   }
+   pending_filter_count += block.docs.size();
+   pending_filter_bytes += block.docs.byte_size();
+   const auto add_to = [this, &block]( size_t partition ) {
+      if( pending_filter_docs[partition].empty() || block.queued_at < pending_queued_at[partition] ) {
+         pending_queued_at[partition] = block.queued_at;
+      }
+   };
+   if( writers.size() <= 1 ) {
+      // the buffer of the block becomes the batch, or is appended to it in one go
+      add_to( 0 );
+      auto& pending = pending_filter_docs[0];
+      if( pending.empty() ) {
+         pending = std::move( block.docs );
+      } else {
+         pending.append( block.docs );
+      }
+   } else {
+      block.docs.for_each( [this, &add_to]( const bsoncxx::document::view& doc ) {
+         const size_t partition = partition_of( doc );
+         add_to( partition );
+         pending_filter_docs[partition].append( doc );
+      } );
+   }
+   block.docs.clear();
 
-   mongocxx::bulk_write bulk_filter = filter.create_bulk_write(bulk_opts);
+   // blocks are never split over bulk writes
+   if( pending_filter_count >= ( catching_up ? catch_up_batch_docs : batch_max_docs ) || pending_filter_bytes >= batch_max_bytes ) {
+      flush_filter_docs();
+   }
+}
 
-   int32_t act_num = 0;
-   auto process_action = [&](const std::string& trx_id_str, const chain::action& act, bbb::array& act_array, bool cfa) -> auto {
-      auto act_doc = bsoncxx::builder::basic::document();
-      if( start_block_reached ) {
-         act_doc.append( kvp( "action_num", b_int32{act_num} ),
-                         kvp( "trx_id", trx_id_str ));
-         act_doc.append( kvp( "cfa", b_bool{cfa} ));
-         act_doc.append( kvp( "account", act.account.to_string()));
-         act_doc.append( kvp( "name", act.name.to_string()));
-         act_doc.append( kvp( "authorization", [&act]( bsoncxx::builder::basic::sub_array subarr ) {
-            for( const auto& auth : act.authorization ) {
-               subarr.append( [&auth]( bsoncxx::builder::basic::sub_document subdoc ) {
-                  subdoc.append( kvp( "actor", auth.actor.to_string()),
-                                 kvp( "permission", auth.permission.to_string()));
-               } );
+void filter_mongo_db_plugin_impl::flush_filter_docs() {
+   if( pending_filter_count == 0 )
+      return;
+
+   for( size_t i = 0; i < writers.size(); ++i ) {
+      auto& docs = pending_filter_docs[i];
+      if( docs.empty() )
+         continue;
+
+      auto& w = *writers[i];
+      boost::mutex::scoped_lock lock( w.mtx );
+      if( w.spill && ( !w.spill->empty() || w.batches.size() >= writer_max_queued_batches )) {
+         // MongoDB is behind, append after everything spilled before to keep the order
+         const auto spilled = spill_filter_docs( w, docs, flush_seq );
+         docs.erase_front( spilled );
+         if( !docs.empty() && !w.spill->empty() ) {
+            // the spill log failed part way, the rest is queued once the writer has replayed what was spilled
+            wlog( "waiting for filter writer ${i} to replay its spill log before queuing ${n} actions", ("i", i)("n", docs.size()));
+            w.cv.notify_all();
+            while( !w.spill->empty() && !w.done ) {
+               w.cv.wait( lock );
             }
-         } ));
+         }
       }
+      if( !docs.empty() ) {
+         // never let a writer fall more than a few batches behind
+         while( w.batches.size() >= writer_max_queued_batches && !w.done ) {
+            w.cv.wait( lock );
+         }
+         if( w.done ) {
+            elog( "filter writer ${i} is gone, dropping ${n} actions", ("i", i)("n", docs.size()));
+            if( w.unwritten_seq == 0 ) {
+               w.unwritten_seq = flush_seq;
+            }
+         } else {
+            w.batches.emplace_back( write_batch{ std::move( docs ), pending_queued_at[i], catching_up, flush_seq } );
+         }
+      }
+      docs.clear();
+      lock.unlock();
+      w.cv.notify_all();
+   }
+   pending_filter_count = 0;
+   pending_filter_bytes = 0;
+   ++flush_seq;
+}
+
+void filter_mongo_db_plugin_impl::flush_stats() {
+   stats_flushed_at = boost::chrono::steady_clock::now();
+   if( stats->empty() )
+      return;
+   auto coll = (*mongo_conn)[db_name][stats_col];
+   if( !stats->flush( coll )) {
+      metrics.local().mongo_errors.add();
+   }
+}
+
+namespace {
+
+   uint32_t block_num_of( const bsoncxx::document::element& e ) {
+      if( e && e.type() == bsoncxx::type::k_int32 )
+         return static_cast<uint32_t>( e.get_int32().value );
+      if( e && e.type() == bsoncxx::type::k_int64 )
+         return static_cast<uint32_t>( e.get_int64().value );
+      return 0;
+   }
+
+   /// upserts fields into the checkpoint document, journaled so the filter writes acknowledged before it are durable too
+   bool update_checkpoint( mongocxx::collection meta, bsoncxx::document::value&& fields ) {
+      using namespace bsoncxx::types;
+      using bsoncxx::builder::basic::make_document;
+      using bsoncxx::builder::basic::kvp;
       try {
-         update_account( accounts, act );
-      } catch (...) {
-         ilog( "Unable to update account for ${s}::${n}", ("s", act.account)( "n", act.name ));
+         mongocxx::write_concern journaled;
+         journaled.journal( true );
+         mongocxx::options::update opts;
+         opts.upsert( true );
+         opts.write_concern( journaled );
+         meta.update_one( make_document( kvp( "_id", "checkpoint" )), make_document( kvp( "$set", std::move( fields ))), opts );
+         return true;
+      } catch( std::exception& e ) {
+         elog( "Unable to update the filter checkpoint: ${e}", ("e", e.what()));
       }
-      if( start_block_reached ) {
-         add_data( act_doc, accounts, act );
-         act_array.append( act_doc );
-         mongocxx::model::insert_one insert_op{act_doc.view()};
+      return false;
+   }
 
-         auto it = std::find(filter_contract.begin(), filter_contract.end(), act.account.to_string());
+}
 
-         if ( it != filter_contract.end() ) {
-            bulk_filter.append( insert_op );
-            filter_to_write = true;
-         }
+bool filter_mongo_db_plugin_impl::load_checkpoint() {
+   using bsoncxx::builder::basic::make_document;
+   using bsoncxx::builder::basic::kvp;
 
-         actions_to_write = true;
+   auto checkpoint = (*mongo_conn)[db_name][meta_col].find_one( make_document( kvp( "_id", "checkpoint" )));
+   if( !checkpoint )
+      return false;
+   const auto view = checkpoint->view();
+   upsert_until_block = block_num_of( view["reserved_block_num"] );
+   reserved_block_num = upsert_until_block;
+   if( stats ) {
+      stats->set_resume_until( upsert_until_block );
+   }
+   const auto id = view["block_id"];
+   if( id && id.type() == bsoncxx::type::k_utf8 ) {
+      const auto hex = id.get_utf8().value;
+      resume_block = block_ref{ block_num_of( view["block_num"] ), block_id_type( std::string( hex.data(), hex.size() )) };
+      if( resume_block->block_num >= start_block_num ) {
+         start_block_num = resume_block->block_num + 1;
       }
+      ilog( "resuming after the checkpoint at block ${n}, writing filtered actions from block ${s} on",
+            ("n", resume_block->block_num)("s", start_block_num) );
+   }
+   if( upsert_until_block >= start_block_num ) {
+      ilog( "upserting the filtered actions of blocks ${s} to ${u}, they may have been written before the restart",
+            ("s", start_block_num)("u", upsert_until_block) );
+   }
+   return true;
+}
 
-      ++act_num;
-      return act_num;
-   };
+void filter_mongo_db_plugin_impl::block_handed( uint32_t block_num, const block_id_type& id ) {
+   if( !checkpoint_enabled || block_num < start_block_num )
+      return;
+   if( block_num > reserved_block_num ) {
+      using namespace bsoncxx::types;
+      using bsoncxx::builder::basic::make_document;
+      using bsoncxx::builder::basic::kvp;
+      const uint32_t reserve = block_num + reserve_blocks;
+      if( update_checkpoint( (*mongo_conn)[db_name][meta_col],
+                             make_document( kvp( "reserved_block_num", b_int32{ static_cast<int32_t>( reserve ) } )))) {
+         reserved_block_num = reserve;
+      } else {
+         // tried again with the next block; a restart before that may write these actions twice
+         metrics.local().mongo_errors.add();
+      }
+   }
+   if( checkpoint_frozen )
+      return;
+   if( !handed_blocks.empty() && handed_blocks.back().first == flush_seq ) {
+      handed_blocks.back().second = block_ref{ block_num, id };
+   } else {
+      handed_blocks.emplace_back( flush_seq, block_ref{ block_num, id } );
+   }
+}
 
-   if( !trx.actions.empty()) {
-      bsoncxx::builder::basic::array action_array;
-      for( const auto& act : trx.actions ) {
-         process_action( trx_id_str, act, action_array, false );
+uint64_t filter_mongo_db_plugin_impl::written_seq() {
+   // the flushes before the pending documents, or all of them
+   uint64_t seq = pending_filter_count > 0 ? flush_seq - 1 : flush_seq;
+   for( auto& w : writers ) {
+      boost::mutex::scoped_lock lock( w->mtx );
+      for( const uint64_t unwritten : { w->unwritten_seq, w->spilled_seq, w->unsynced_seq, w->rejected_seq,
+                                        w->batches.empty() ? uint64_t( 0 ) : w->batches.front().seq } ) {
+         if( unwritten > 0 )
+            seq = std::min( seq, unwritten - 1 );
       }
-      trans_doc.append( kvp( "actions", action_array ));
    }
+   return seq;
+}
+
+void filter_mongo_db_plugin_impl::write_checkpoint() {
+   using namespace bsoncxx::types;
+   using bsoncxx::builder::basic::make_document;
+   using bsoncxx::builder::basic::kvp;
+
+   checkpoint_written_at = boost::chrono::steady_clock::now();
+   const uint64_t seq = written_seq();
+   while( !handed_blocks.empty() && handed_blocks.front().first <= seq ) {
+      checkpoint_pending = handed_blocks.front().second;
+      handed_blocks.pop_front();
+   }
+   if( !checkpoint_pending )
+      return;
+
+   auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+         std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()});
+   if( update_checkpoint( (*mongo_conn)[db_name][meta_col],
+                          make_document( kvp( "block_num", b_int32{ static_cast<int32_t>( checkpoint_pending->block_num ) } ),
+                                         kvp( "block_id", checkpoint_pending->block_id.str() ),
+                                         kvp( "updatedAt", b_date{now} )))) {
+      checkpoint_pending.reset();
+   } else {
+      metrics.local().mongo_errors.add();
+   }
+}
+
+size_t filter_mongo_db_plugin_impl::spill_filter_docs( filter_writer& w, const doc_buffer& docs, uint64_t seq ) {
+   size_t spilled = 0;
+   try {
+      docs.for_each( [&]( const bsoncxx::document::view& doc ) {
+         w.spill->append( doc );
+         ++spilled;
+      } );
+      w.spill->sync();
+   } catch( fc::exception& e ) {
+      elog( "Unable to spill filtered actions to disk: ${e}", ("e", e.to_string()));
+   } catch( std::exception& e ) {
+      elog( "Unable to spill filtered actions to disk: ${e}", ("e", e.what()));
+   }
+   spilled_filter_docs += spilled;
+   if( spilled > 0 && w.spilled_seq == 0 ) {
+      w.spilled_seq = seq;
+   }
+   return spilled;
+}
+
+void filter_mongo_db_plugin_impl::start_writers( uint32_t n ) {
+   pending_filter_docs.resize( n );
+   pending_queued_at.resize( n );
+   for( uint32_t i = 0; i < n; ++i ) {
+      writers.emplace_back( new filter_writer );
+      auto& sink = writers.back()->sink;
+      switch( output_sink ) {
+         case sink_type::mongo:
+            sink = make_mongo_sink( *mongo_pool, db_name, filter_col, catch_up_concern, upsert, upsert_until_block );
+            break;
+         case sink_type::file:
+            sink = make_file_sink( output_dir / ( "writer-" + std::to_string( i )), output_segment_size, output_segment_age );
+            break;
+         case sink_type::null:
+            sink = make_null_sink();
+            break;
+      }
+   }
+   if( !spill_dir.empty() ) {
+      const auto writer_dir = [&]( uint32_t i ) { return spill_dir / ( "writer-" + std::to_string( i )); };
+      for( uint32_t i = 0; i < n; ++i ) {
+         writers[i]->spill.reset( new spill_log( writer_dir( i ), spill_segment_size ));
+         // left from the last run, nothing new is checkpointed before it is replayed
+         if( !writers[i]->spill->empty() ) {
+            writers[i]->spilled_seq = 1;
+         }
+      }
+      for( uint32_t i = n; boost::filesystem::exists( writer_dir( i )); ++i ) {
+         FC_ASSERT( spill_log( writer_dir( i ), spill_segment_size ).empty(),
+                    "Spill log ${d} needs at least ${n} filter-mongodb-writer-threads to be replayed",
+                    ("d", writer_dir( i ).string())("n", i + 1) );
+      }
+   }
+   for( auto& w : writers ) {
+      auto* wp = w.get();
+      w->thread = boost::thread( [this, wp] { writer_loop( *wp ); } );
+   }
+}
+
+void filter_mongo_db_plugin_impl::stop_writers() {
+   for( auto& w : writers ) {
+      {
+         boost::mutex::scoped_lock lock( w->mtx );
+         w->done = true;
+      }
+      w->cv.notify_all();
+   }
+   for( auto& w : writers ) {
+      if( w->thread.joinable() )
+         w->thread.join();
+   }
+}
 
+void filter_mongo_db_plugin_impl::writer_loop( filter_writer& w ) {
+   // relaxed writes that are not known to be durable yet
+   bool unsynced = false;
+   auto synced_at = boost::chrono::steady_clock::now();
+   try {
+      doc_buffer docs;
+      bool unreachable_on_shutdown = false;
+      while( true ) {
+         bool from_spill = false;
+         bool relaxed = false;
+         uint64_t seq = 0;
+         boost::chrono::steady_clock::time_point queued_at;
+         {
+            boost::mutex::scoped_lock lock( w.mtx );
+            while( w.batches.empty() && !w.done && !( w.spill && !w.spill->empty() )) {
+               w.cv.wait( lock );
+            }
+            if( !w.batches.empty() ) {
+               docs = std::move( w.batches.front().docs );
+               queued_at = w.batches.front().queued_at;
+               relaxed = w.batches.front().relaxed;
+               seq = w.batches.front().seq;
+               w.unwritten_seq = seq;
+               w.batches.pop_front();
+            } else if( !w.done && w.spill && !w.spill->empty() ) {
+               relaxed = catching_up;
+               seq = w.spilled_seq;
+               w.spill->read( docs, relaxed ? catch_up_batch_docs : batch_max_docs );
+               from_spill = true;
+            } else {
+               // a spill log that is not empty yet is replayed after the next start
+               break;
+            }
+         }
+         w.cv.notify_all();
+
+         // rejected documents are dropped, writing them again would not help
+         bool rejected = false;
+         const auto write = [&]() {
+            // the first safe write after catch-up waits until the relaxed writes are durable
+            if( !relaxed && unsynced ) {
+               if( !sync_sink( *w.sink ))
+                  return false;
+               unsynced = false;
+               synced_at = boost::chrono::steady_clock::now();
+               boost::mutex::scoped_lock lock( w.mtx );
+               w.unsynced_seq = 0;
+            }
+            const auto result = write_filter_docs( *w.sink, docs, relaxed );
+            rejected = result == action_sink::write_result::rejected;
+            return result != action_sink::write_result::retry;
+         };
+         bool written = !unreachable_on_shutdown && write();
+         // the sink is unavailable, hold on to the documents until it is back or the plugin stops
+         while( !written ) {
+            {
+               boost::mutex::scoped_lock lock( w.mtx );
+               if( !w.done )
+                  w.cv.wait_for( lock, boost::chrono::seconds( 1 ));
+               if( w.done )
+                  break;
+            }
+            written = write();
+         }
+         if( written && relaxed ) {
+            unsynced = true;
+            // unacknowledged writes hold back the checkpoint until they are synced, so a long catch-up syncs now and then
+            const auto now = boost::chrono::steady_clock::now();
+            if( !catch_up_concern.is_acknowledged() && now - synced_at >= unacknowledged_sync_interval ) {
+               synced_at = now;
+               unsynced = !sync_sink( *w.sink );
+            }
+         }
 
-   if( start_block_reached ) {
+         if( written && !from_spill ) {
+            metrics.local().write_latency_us.record( boost::chrono::duration_cast<boost::chrono::microseconds>(
+                  boost::chrono::steady_clock::now() - queued_at ).count() );
+         }
 
-      if( actions_to_write ) {
-        //  auto result = bulk_actions.execute();
-        //  if( !result ) {
-        //     elog( "Bulk actions insert failed for transaction: ${id}", ("id", trx_id_str));
-        //  }
-         if ( filter_to_write ) {
-            auto result = bulk_filter.execute();
-            if( !result ) {
-                elog( "Bulk sic insert failed for transaction: ${id}", ("id", trx_id_str));
+         boost::mutex::scoped_lock lock( w.mtx );
+         // the checkpoint stays before rejected documents, a restart writes them again
+         if( rejected && w.rejected_seq == 0 ) {
+            w.rejected_seq = seq;
+            wlog( "${n} filtered actions were rejected, the checkpoint stays before them until the next restart", ("n", docs.size()));
+         }
+         // unacknowledged writes are only known to be stored once synced
+         if( !unsynced ) {
+            w.unsynced_seq = 0;
+         } else if( written && relaxed && !catch_up_concern.is_acknowledged() && w.unsynced_seq == 0 ) {
+            w.unsynced_seq = seq;
+         }
+         if( from_spill ) {
+            if( written ) {
+               w.spill->ack();
+               if( w.spill->empty() ) {
+                  w.spilled_seq = 0;
+                  w.cv.notify_all();
+               }
+            } else {
+               w.spill->rewind();
+            }
+         } else if( written ) {
+            w.unwritten_seq = 0;
+         } else {
+            unreachable_on_shutdown = true;
+            if( w.spill ) {
+               if( !w.spill->empty() ) {
+                  wlog( "spilling ${n} unwritten actions behind newer spilled actions", ("n", docs.size()));
+               }
+               const auto spilled = spill_filter_docs( w, docs, seq );
+               if( spilled < docs.size() ) {
+                  elog( "dropping ${n} actions that could not be written before shutdown", ("n", docs.size() - spilled));
+               } else {
+                  w.unwritten_seq = 0;
+               }
+            } else {
+               elog( "dropping ${n} actions that could not be written before shutdown", ("n", docs.size()));
             }
          }
-         
+         docs.clear();
+      }
+   } catch (fc::exception& e) {
+      elog("FC Exception in filter writer ${e}", ("e", e.to_string()));
+   } catch (std::exception& e) {
+      elog("STD Exception in filter writer ${e}", ("e", e.what()));
+   } catch (...) {
+      elog("Unknown exception in filter writer");
+   }
+   const bool synced = !unsynced || sync_sink( *w.sink );
+   if( !synced ) {
+      elog( "relaxed writes of the catch-up mode may not be durable" );
+   }
+   boost::mutex::scoped_lock lock( w.mtx );
+   if( synced ) {
+      w.unsynced_seq = 0;
+   }
+   w.done = true;
+   w.cv.notify_all();
+   lock.unlock();
+   // a file sink completes its open segment
+   w.sink.reset();
+}
+
+bool filter_mongo_db_plugin_impl::sync_sink( action_sink& sink ) {
+   try {
+      sink.sync();
+      return true;
+   } catch( fc::exception& e ) {
+      elog( "Unable to sync the filter writes: ${e}", ("e", e.to_string()));
+   } catch( std::exception& e ) {
+      elog( "Unable to sync the filter writes: ${e}", ("e", e.what()));
+   }
+   metrics.local().write_errors.add();
+   return false;
+}
+
+action_sink::write_result filter_mongo_db_plugin_impl::write_filter_docs( action_sink& sink, const doc_buffer& docs, bool relaxed ) {
+   if( docs.empty() )
+      return action_sink::write_result::written;
+
+   auto& m = metrics.local();
+   const auto start = boost::chrono::steady_clock::now();
+   const auto result = sink.write( docs, relaxed );
+   if( result != action_sink::write_result::written ) {
+      m.write_errors.add();
+      if( result == action_sink::write_result::rejected ) {
+         m.rejected_writes.add();
+         m.rejected_docs.add( docs.size() );
       }
+      return result;
+   }
+   m.bulk_writes.add();
+   m.written_docs.add( docs.size() );
+   m.bulk_write_docs.record( docs.size() );
+   m.bulk_write_us.record( boost::chrono::duration_cast<boost::chrono::microseconds>( boost::chrono::steady_clock::now() - start ).count() );
+   return result;
+}
+
+fc::variant filter_mongo_db_plugin_impl::get_metrics()const {
+   auto result = metrics.snapshot();
+
+   if( event_queue ) {
+      result( "queue", fc::mutable_variant_object()
+            ( "depth", event_queue->size() )
+            ( "capacity", event_queue->capacity() )
+            ( "spilled_depth", spill_size.load() )
+            ( "producer_blocked_ms", producer_blocked_us.load() / 1000 )
+            ( "dropped_transactions", dropped_transactions.load() )
+            ( "spilled_transactions", spilled_events.load() ));
+   }
+
+   fc::variants writer_state;
+   for( const auto& w : writers ) {
+      boost::mutex::scoped_lock lock( w->mtx );
+      writer_state.emplace_back( fc::mutable_variant_object()
+            ( "queued_batches", w->batches.size() )
+            ( "spilling", w->spill && !w->spill->empty() ));
    }
+   result( "writers", std::move( writer_state ));
+   result( "spilled_actions", spilled_filter_docs.load() );
+   return result;
 }
 
+void filter_mongo_db_plugin_impl::log_metrics() {
+   using pm = pipeline_metrics;
+   const auto now = boost::chrono::steady_clock::now();
+   const double seconds = boost::chrono::duration<double>( now - metrics_logged_at ).count();
+   const uint64_t transactions = metrics.total( &pm::shard::transactions );
+   const uint64_t actions = metrics.total( &pm::shard::actions );
+
+   ilog( "queue ${q}/${c}, ${t} trx/s, ${a} actions/s, latency p99 queue ${lq} us decode ${ld} us write ${lw} us, "
+         "bulk write p99 ${bw} us, abi hits ${h} misses ${m}, write errors ${we}, mongo errors ${e}",
+         ("q", event_queue->size() + spill_size.load())("c", event_queue->capacity())
+         ("t", uint64_t( (transactions - metrics_logged_transactions) / seconds ))
+         ("a", uint64_t( (actions - metrics_logged_actions) / seconds ))
+         ("lq", metrics.percentile( &pm::shard::queue_latency_us, 0.99 ))
+         ("ld", metrics.percentile( &pm::shard::decode_latency_us, 0.99 ))
+         ("lw", metrics.percentile( &pm::shard::write_latency_us, 0.99 ))
+         ("bw", metrics.percentile( &pm::shard::bulk_write_us, 0.99 ))
+         ("h", metrics.total( &pm::shard::abi_hits ))("m", metrics.total( &pm::shard::abi_misses ))
+         ("we", metrics.total( &pm::shard::write_errors ))("e", metrics.total( &pm::shard::mongo_errors )) );
+
+   metrics_logged_at = now;
+   metrics_logged_transactions = transactions;
+   metrics_logged_actions = actions;
+}
 
 filter_mongo_db_plugin_impl::filter_mongo_db_plugin_impl()
 : mongo_inst{}
-, mongo_conn{}
 {
 }
 
@@ -491,22 +1708,61 @@ filter_mongo_db_plugin_impl::~filter_mongo_db_plugin_impl() {
       try {
          ilog( "filter_mongo_db_plugin shutdown in process please be patient this can take a few minutes" );
          done = true;
-         condition.notify_one();
+         event_queue->notify_consumer();
+         {
+            boost::mutex::scoped_lock lock( spill_mtx );
+         }
+         spill_cv.notify_all();
 
          consume_thread.join();
+         ilog( "queue: producer blocked ${b} ms, dropped ${d} transactions, spilled ${s} transactions",
+               ("b", producer_blocked_us.load() / 1000)("d", dropped_transactions.load())("s", spilled_events.load()) );
+         if( !spill_dir.empty() ) {
+            ilog( "spilled ${n} filtered actions to ${d}", ("n", spilled_filter_docs.load())("d", spill_dir.string()) );
+         }
+         ilog( "discarding ${b} reversible blocks and ${t} transactions not yet in a block",
+               ("b", reversible_blocks.size())("t", reversible_trxs.size()) );
+         ilog( "processed ${t} transactions, ${f} matched no filter, ${d} seen before",
+               ("t", metrics.total( &pipeline_metrics::shard::transactions ))
+               ("f", metrics.total( &pipeline_metrics::shard::fast_path_transactions ))
+               ("d", metrics.total( &pipeline_metrics::shard::duplicate_transactions )) );
+         ilog( "abi cache: ${s} entries, ${h} hits, ${m} misses",
+               ("s", abi_cache.size())
+               ("h", metrics.total( &pipeline_metrics::shard::abi_hits ))
+               ("m", metrics.total( &pipeline_metrics::shard::abi_misses )) );
       } catch( std::exception& e ) {
          elog( "Exception on filter_mongo_db_plugin shutdown of consume thread: ${e}", ("e", e.what()));
       }
    }
+   decode_work.reset();
+   decode_thread_pool.join_all();
+   stop_writers();
+   if( checkpoint_enabled ) {
+      write_checkpoint();
+      if( checkpoint_pending || !handed_blocks.empty() ) {
+         wlog( "not all filtered actions were written, the next start resumes after the last checkpoint" );
+      }
+   }
+   if( indexes_deferred ) {
+      wlog( "shut down before catching up, the indexes are created on the next start" );
+   }
+   if( index_thread.joinable() ) {
+      ilog( "waiting for the index build to finish" );
+      index_thread.join();
+   }
 }
 
 void filter_mongo_db_plugin_impl::wipe_database() {
    ilog("mongo db wipe_database");
 
-   auto contract = mongo_conn[db_name][filter_col];
-   accounts = mongo_conn[db_name][accounts_col];
+   auto contract = (*mongo_conn)[db_name][filter_col];
+   auto filter_stats = (*mongo_conn)[db_name][stats_col];
+   auto meta = (*mongo_conn)[db_name][meta_col];
+   accounts = (*mongo_conn)[db_name][accounts_col];
 
    contract.drop();
+   filter_stats.drop();
+   meta.drop();
    accounts.drop();
 }
 
@@ -517,8 +1773,10 @@ void filter_mongo_db_plugin_impl::init() {
    // Create the native contract accounts manually; sadly, we can't run their contracts to make them create themselves
    // See native_contract_chain_initializer::prepare_database()
 
-   accounts = mongo_conn[db_name][accounts_col];
-   if (accounts.count(make_document()) == 0) {
+   accounts = (*mongo_conn)[db_name][accounts_col];
+   mongocxx::options::find any_opts;
+   any_opts.projection( make_document( kvp( "_id", 1 )));
+   if (!accounts.find_one(make_document(), any_opts)) {
       auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()});
 
@@ -530,6 +1788,130 @@ void filter_mongo_db_plugin_impl::init() {
       }
 
    }
+
+   if( indexes_deferred ) {
+      ilog( "deferring index builds until the head block is recent" );
+   } else {
+      create_indexes( *mongo_conn, false );
+   }
+}
+
+void filter_mongo_db_plugin_impl::create_indexes( mongocxx::client& client, bool background ) {
+   using bsoncxx::builder::basic::make_document;
+   using bsoncxx::builder::basic::kvp;
+
+   mongocxx::options::index opts;
+   opts.background( background );
+   auto ensure_index = [&]( mongocxx::collection coll, const std::string& coll_name, const bsoncxx::document::view& keys ) {
+      try {
+         coll.create_index( keys, opts );
+      } catch( std::exception& e ) {
+         elog( "Unable to create index ${k} on ${c}: ${e}",
+               ("k", bsoncxx::to_json( keys ))("c", coll_name)("e", e.what()) );
+      }
+      // an index with the same keys but other options is kept and still serves the lookups
+      for( const auto& index : coll.list_indexes() ) {
+         if( index["key"].get_document().view() == keys )
+            return;
+      }
+      elog( "Index ${k} is missing on ${c}", ("k", bsoncxx::to_json( keys ))("c", coll_name) );
+   };
+
+   if( index_accounts_name ) {
+      ensure_index( client[db_name][accounts_col], accounts_col, make_document( kvp( "name", 1 )));
+   }
+   if( output_sink == sink_type::mongo ) {
+      // upserts, also those of the blocks reserved before a restart, look documents up by trx_id and
+      // action_num; the same index serves trx_id lookups
+      const bool upserts = upsert || checkpoint_enabled;
+      if( index_filter_trx_id || upserts ) {
+         ensure_index( client[db_name][filter_col], filter_col, upserts ?
+                       make_document( kvp( "trx_id", 1 ), kvp( "action_num", 1 )) : make_document( kvp( "trx_id", 1 )));
+      }
+      if( index_filter_block_num ) {
+         ensure_index( client[db_name][filter_col], filter_col, make_document( kvp( "block_num", 1 )));
+      }
+      if( index_filter_account_name ) {
+         ensure_index( client[db_name][filter_col], filter_col, make_document( kvp( "account", 1 ), kvp( "name", 1 )));
+      }
+   }
+   if( stats ) {
+      // the upserts look buckets up by all their keys, dashboards by time range
+      ensure_index( client[db_name][stats_col], stats_col, stats->index_keys() );
+   }
+}
+
+void filter_mongo_db_plugin_impl::load_accounts() {
+   using bsoncxx::builder::basic::make_document;
+   using bsoncxx::builder::basic::kvp;
+
+   // the abis of the filter contracts are loaded up front, those of notification senders on first use
+   const auto& contracts = filter.contracts_named();
+   if( contracts.empty() )
+      return;
+
+   const auto start = fc::time_point::now();
+   bsoncxx::builder::basic::array names;
+   for( const auto& n : contracts ) {
+      names.append( n.to_string() );
+   }
+   mongocxx::options::find opts;
+   opts.projection( make_document( kvp( "_id", 0 ), kvp( "name", 1 ), kvp( "abi", 1 )));
+   std::vector<bsoncxx::document::value> docs;
+   auto cursor = accounts.find( make_document( kvp( "name", make_document( kvp( "$in", names.extract() ))),
+                                               kvp( "abi", make_document( kvp( "$exists", true )))), opts );
+   for( const auto& doc : cursor ) {
+      docs.emplace_back( doc );
+   }
+
+   // building a serializer validates the whole abi, spread that over a few threads
+   struct loaded {
+      account_name                          name;
+      account_registry::abi_ptr             abi;
+      abi_serializer_cache::serializer_ptr  abis;
+   };
+   std::vector<loaded> built( docs.size() );
+   std::atomic<size_t> next{0};
+   const auto build = [&]( bool serializers ) {
+      for( size_t i = next++; i < docs.size(); i = next++ ) {
+         const auto view = docs[i].view();
+         std::string name;
+         if( view["name"] && view["name"].type() == bsoncxx::type::k_utf8 ) {
+            const auto n = view["name"].get_utf8().value;
+            name.assign( n.data(), n.size() );
+         }
+         try {
+            built[i].name = account_name( name );
+            built[i].abi = std::make_shared<abi_def>( from_bson( view["abi"].get_document().value ).as<abi_def>() );
+            if( serializers )
+               built[i].abis = std::make_shared<abi_serializer>( *built[i].abi );
+         } catch( ... ) {
+            ilog( "Unable to convert account abi to abi_def for ${n}", ("n", name) );
+         }
+      }
+   };
+   if( abi_warm_threads == 0 ) {
+      build( false );
+   } else {
+      boost::thread_group threads;
+      for( size_t i = 0; i < std::min<size_t>( abi_warm_threads, docs.size() ); ++i ) {
+         threads.create_thread( [&build] { build( true ); } );
+      }
+      threads.join_all();
+   }
+
+   size_t warmed = 0;
+   for( auto& b : built ) {
+      if( !b.abi )
+         continue;
+      registry.load( b.name, std::move( b.abi ));
+      if( b.abis ) {
+         abi_cache.put( b.name, std::move( b.abis ));
+         ++warmed;
+      }
+   }
+   ilog( "loaded the abis of ${n} of ${c} filter contracts, ${w} serializers built, in ${t} ms",
+         ("n", docs.size())("c", contracts.size())("w", warmed)("t", ( fc::time_point::now() - start ).count() / 1000) );
 }
 
 ////////////
@@ -548,14 +1930,91 @@ filter_mongo_db_plugin::~filter_mongo_db_plugin()
 void filter_mongo_db_plugin::set_program_options(options_description& cli, options_description& cfg)
 {
    cfg.add_options()
-         ("filter-contract", bpo::value< vector<string> >()->composing(), "Filter the contract actions by contract acccount name.") 
+         ("filter-contract", bpo::value< vector<string> >()->composing(), "Filter the contract actions, use contract, contract:action or contract:action:actor.") 
          ("filter-mongodb-queue-size,q", bpo::value<uint32_t>()->default_value(256),
          "The target queue size between nodeos and MongoDB plugin thread.")
+         ("filter-mongodb-queue-overflow", bpo::value<std::string>()->default_value("block"),
+         "What to do with a transaction when the queue is full: block (wait for the MongoDB plugin thread), "
+         "drop (discard and count it) or spill (keep it in an overflow queue of filter-mongodb-queue-spill-size transactions, then block).")
+         ("filter-mongodb-queue-spill-size", bpo::value<uint32_t>()->default_value(65536),
+         "Maximum number of transactions in the overflow queue of filter-mongodb-queue-overflow spill.")
+         ("filter-mongodb-irreversible-only", bpo::bool_switch()->default_value(false),
+         "Write filtered actions only once their block becomes irreversible. Actions of failed, expired and forked out transactions are never written.")
+         ("filter-mongodb-abi-cache-size", bpo::value<uint32_t>()->default_value(1024),
+         "Maximum number of account abi serializers kept in memory, 0 disables the cache.")
+         ("filter-mongodb-abi-warm-threads", bpo::value<uint32_t>()->default_value(4),
+         "Number of threads building the abi serializers of the filter contracts at startup, 0 builds them on first use.")
+         ("filter-mongodb-dedup-size", bpo::value<uint32_t>()->default_value(1000000),
+         "Maximum number of transaction ids remembered to skip transactions the controller signals again, 0 disables it.")
+         ("filter-mongodb-inline-actions", bpo::bool_switch()->default_value(false),
+         "Take filtered actions from the action traces of applied transactions, so inline actions are written too, and "
+         "notifications a filter contract receives that match its rules by action name and actor, each with its receiver and global_sequence.")
+         ("filter-mongodb-upsert", bpo::bool_switch()->default_value(false),
+         "Upsert filtered actions by trx_id and action_num instead of inserting them, so writing an action twice leaves one document.")
+         ("filter-mongodb-raw-data", bpo::value<std::string>()->default_value("fallback"),
+         "When the action data is stored undecoded as BSON binary raw_data: fallback (for actions that cannot be decoded), "
+         "always (next to the decoded data) or only (instead of the decoded data, leaving decoding to the readers).")
+         ("filter-mongodb-decode-threads", bpo::value<uint32_t>()->default_value(0),
+         "Number of worker threads decoding filtered actions, 0 decodes on the MongoDB plugin thread.")
+         ("filter-mongodb-writer-threads", bpo::value<uint32_t>()->default_value(1),
+         "Number of threads writing filtered actions to MongoDB, each with its own pooled connection.")
+         ("filter-mongodb-writer-partition", bpo::value<std::string>()->default_value("account"),
+         "How filtered actions are spread over the writer threads: account (keeps the order per contract) or trx_id.")
+         ("filter-mongodb-spill-dir", bpo::value<boost::filesystem::path>(),
+         "Directory of the on-disk log for filtered actions MongoDB does not keep up with, replayed in order once it does "
+         "(relative paths are relative to the data dir). Without it writes wait for MongoDB.")
+         ("filter-mongodb-spill-segment-mb", bpo::value<uint32_t>()->default_value(64),
+         "Size in MB of one spill log segment file.")
+         ("filter-mongodb-batch-docs", bpo::value<uint32_t>()->default_value(1000),
+         "Maximum number of filtered actions collected across transactions into one bulk write.")
+         ("filter-mongodb-batch-bytes", bpo::value<uint32_t>()->default_value(8*1024*1024),
+         "Maximum size in bytes of filtered actions collected into one bulk write.")
+         ("filter-mongodb-batch-latency-ms", bpo::value<uint32_t>()->default_value(500),
+         "Maximum time in milliseconds a filtered action waits in a batch before the batch is written.")
+         ("filter-mongodb-catch-up", bpo::value<bool>()->default_value(true),
+         "While accepted blocks are more than 5 minutes old, write batches of filter-mongodb-catch-up-batch-docs actions with "
+         "filter-mongodb-catch-up-write-concern, and fsync once blocks are less than 30 seconds old again.")
+         ("filter-mongodb-catch-up-batch-docs", bpo::value<uint32_t>()->default_value(10000),
+         "Maximum number of filtered actions in one bulk write in catch-up mode.")
+         ("filter-mongodb-catch-up-write-concern", bpo::value<std::string>()->default_value("unacknowledged"),
+         "Write concern of the bulk writes in catch-up mode: unacknowledged (w:0, fire and forget, write errors are not seen), "
+         "unjournaled (w:1 with j:false, only relaxes a filter-mongodb-uri asking for journaled writes) or default.")
+         ("filter-mongodb-checkpoint", bpo::value<bool>()->default_value(true),
+         "Keep the last block whose filtered actions are all written in the filter_meta collection and resume after it on restart, with the mongo sink.")
+         ("filter-mongodb-stats-interval-sec", bpo::value<uint32_t>()->default_value(0),
+         "Seconds between upserts of the aggregates of the written actions into the filter_stats collection, 0 disables them.")
+         ("filter-mongodb-stats-bucket-sec", bpo::value<uint32_t>()->default_value(60),
+         "Length in seconds of the block time buckets of filter_stats.")
+         ("filter-mongodb-stats-dimensions", bpo::value<std::string>()->default_value("account,name"),
+         "What the action counts of filter_stats are grouped by besides the bucket, a comma separated list of account, name and actor.")
+         ("filter-mongodb-stats-unique-actors", bpo::bool_switch()->default_value(false),
+         "Keep the set of distinct actors of every filter_stats document in its actors array.")
+         ("filter-mongodb-metrics-log-interval", bpo::value<uint32_t>()->default_value(0),
+         "Seconds between summary log lines of the pipeline metrics, 0 disables them.")
          ("filter-mongodb-wipe", bpo::bool_switch()->default_value(false),
          "Required with --replay-blockchain, --hard-replay-blockchain, or --delete-all-blocks to wipe mongo db."
          "This option required to prevent accidental wipe of mongo db.")
+         ("filter-mongodb-index-accounts-name", bpo::value<bool>()->default_value(true),
+         "Create an index on name in the accounts collection.")
+         ("filter-mongodb-index-filter-trx-id", bpo::value<bool>()->default_value(true),
+         "Create an index on trx_id in the filter collection.")
+         ("filter-mongodb-index-filter-account-name", bpo::value<bool>()->default_value(true),
+         "Create an index on account and name in the filter collection.")
+         ("filter-mongodb-index-filter-block-num", bpo::value<bool>()->default_value(true),
+         "Create an index on block_num in the filter collection.")
+         ("filter-mongodb-defer-indexes", bpo::bool_switch()->default_value(false),
+         "With filter-mongodb-wipe, create the indexes in the background once the head block is recent instead of before the replay.")
          ("filter-mongodb-block-start", bpo::value<uint32_t>()->default_value(0),
          "If specified then no data pushed to mongodb until accepted block is reached.")
+         ("filter-mongodb-sink", bpo::value<std::string>()->default_value("mongo"),
+         "Where filtered actions are written: mongo (the filter collection), file (BSON segment files for bulk loading) "
+         "or null (counted and dropped, for benchmarks). Without filter-mongodb-uri accounts are kept in memory only.")
+         ("filter-mongodb-sink-dir", bpo::value<boost::filesystem::path>()->default_value("filter-actions"),
+         "Directory of the file sink segments, one subdirectory per writer thread (relative paths are relative to the data dir).")
+         ("filter-mongodb-sink-segment-mb", bpo::value<uint32_t>()->default_value(256),
+         "Size in MB at which the file sink completes a segment and starts the next one.")
+         ("filter-mongodb-sink-segment-sec", bpo::value<uint32_t>()->default_value(0),
+         "Age in seconds at which the file sink completes a segment on the next write, 0 completes segments by size only.")
          ("filter-mongodb-uri,m", bpo::value<std::string>(),
          "MongoDB URI connection string, see: https://docs.mongodb.com/master/reference/connection-string/."
                " If not specified then plugin is disabled. Default database 'EOS' is used if not specified in URI."
@@ -566,14 +2025,19 @@ void filter_mongo_db_plugin::set_program_options(options_description& cli, optio
 void filter_mongo_db_plugin::plugin_initialize(const variables_map& options)
 {
    try {
-      if( options.count( "filter-mongodb-uri" )) {
+      const auto sink = options.at( "filter-mongodb-sink" ).as<std::string>();
+      if( options.count( "filter-mongodb-uri" ) || sink != "mongo" ) {
          ilog( "initializing filter_mongo_db_plugin" );
          my->configured = true;
 
+         // a replay without a wipe is only safe with a checkpoint to resume after, checked once connected
+         bool resume_replay = false;
          if( options.at( "replay-blockchain" ).as<bool>() || options.at( "hard-replay-blockchain" ).as<bool>() || options.at( "delete-all-blocks" ).as<bool>() ) {
             if( options.at( "filter-mongodb-wipe" ).as<bool>()) {
                ilog( "Wiping mongo database on startup" );
                my->wipe_database_on_startup = true;
+            } else if( options.count( "filter-mongodb-uri" ) && sink == "mongo" && options.at( "filter-mongodb-checkpoint" ).as<bool>() ) {
+               resume_replay = true;
             } else {
                FC_ASSERT( false, "--filter-mongodb-wipe required with --replay-blockchain, --hard-replay-blockchain, or --delete-all-blocks"
                                  " --filter-mongodb-wipe will remove all EOS collections from mongodb." );
@@ -583,27 +2047,150 @@ void filter_mongo_db_plugin::plugin_initialize(const variables_map& options)
          if( options.count( "filter-mongodb-queue-size" )) {
             my->queue_size = options.at( "filter-mongodb-queue-size" ).as<uint32_t>();
          }
+         my->event_queue.reset( new spsc_ring<filter_mongo_db_plugin_impl::queued_event>( std::max<size_t>( my->queue_size, 1 )));
+         const auto overflow = options.at( "filter-mongodb-queue-overflow" ).as<std::string>();
+         if( overflow == "block" ) {
+            my->queue_overflow = filter_mongo_db_plugin_impl::overflow_policy::block;
+         } else if( overflow == "drop" ) {
+            my->queue_overflow = filter_mongo_db_plugin_impl::overflow_policy::drop;
+         } else if( overflow == "spill" ) {
+            my->queue_overflow = filter_mongo_db_plugin_impl::overflow_policy::spill;
+            my->spill_max_events = std::max( options.at( "filter-mongodb-queue-spill-size" ).as<uint32_t>(), 1u );
+         } else {
+            FC_ASSERT( false, "Invalid filter-mongodb-queue-overflow ${o}, expected block, drop or spill", ("o", overflow) );
+         }
+         my->batch_max_docs = std::max( options.at( "filter-mongodb-batch-docs" ).as<uint32_t>(), 1u );
+         my->batch_max_bytes = options.at( "filter-mongodb-batch-bytes" ).as<uint32_t>();
+         my->batch_max_latency = boost::chrono::milliseconds( options.at( "filter-mongodb-batch-latency-ms" ).as<uint32_t>() );
+         my->irreversible_only = options.at( "filter-mongodb-irreversible-only" ).as<bool>();
+         my->decode_threads = options.at( "filter-mongodb-decode-threads" ).as<uint32_t>();
+         const auto partition = options.at( "filter-mongodb-writer-partition" ).as<std::string>();
+         if( partition == "account" ) {
+            my->writer_partition = filter_mongo_db_plugin_impl::partition_key::account;
+         } else if( partition == "trx_id" ) {
+            my->writer_partition = filter_mongo_db_plugin_impl::partition_key::trx_id;
+         } else {
+            FC_ASSERT( false, "Invalid filter-mongodb-writer-partition ${p}, expected account or trx_id", ("p", partition) );
+         }
+         if( my->decode_threads > 0 ) {
+            // started here so transactions replayed before plugin_startup are decoded too
+            my->decode_work.emplace( my->decode_ios );
+            for( uint32_t i = 0; i < my->decode_threads; ++i ) {
+               my->decode_thread_pool.create_thread( [this] { my->decode_ios.run(); } );
+            }
+         }
+         if( options.count( "filter-mongodb-abi-cache-size" )) {
+            my->abi_cache.set_max_size( options.at( "filter-mongodb-abi-cache-size" ).as<uint32_t>() );
+         }
+         my->abi_warm_threads = options.at( "filter-mongodb-abi-warm-threads" ).as<uint32_t>();
+         my->seen_trxs = trx_dedup( options.at( "filter-mongodb-dedup-size" ).as<uint32_t>(), chain::config::default_max_trx_lifetime );
+         my->upsert = options.at( "filter-mongodb-upsert" ).as<bool>();
+         my->inline_actions = options.at( "filter-mongodb-inline-actions" ).as<bool>();
+         if( my->inline_actions ) {
+            my->seen_traces = trx_dedup( options.at( "filter-mongodb-dedup-size" ).as<uint32_t>(), chain::config::default_max_trx_lifetime );
+         }
+         const auto raw_data = options.at( "filter-mongodb-raw-data" ).as<std::string>();
+         if( raw_data == "fallback" ) {
+            my->raw_data = filter_mongo_db_plugin_impl::raw_data_mode::fallback;
+         } else if( raw_data == "always" ) {
+            my->raw_data = filter_mongo_db_plugin_impl::raw_data_mode::always;
+         } else if( raw_data == "only" ) {
+            my->raw_data = filter_mongo_db_plugin_impl::raw_data_mode::only;
+         } else {
+            FC_ASSERT( false, "Invalid filter-mongodb-raw-data ${r}, expected fallback, always or only", ("r", raw_data) );
+         }
+         my->index_accounts_name = options.at( "filter-mongodb-index-accounts-name" ).as<bool>();
+         my->index_filter_trx_id = options.at( "filter-mongodb-index-filter-trx-id" ).as<bool>();
+         my->index_filter_account_name = options.at( "filter-mongodb-index-filter-account-name" ).as<bool>();
+         my->index_filter_block_num = options.at( "filter-mongodb-index-filter-block-num" ).as<bool>();
+         my->catch_up_enabled = options.at( "filter-mongodb-catch-up" ).as<bool>();
+         my->catch_up_batch_docs = std::max( options.at( "filter-mongodb-catch-up-batch-docs" ).as<uint32_t>(), 1u );
+         const auto concern = options.at( "filter-mongodb-catch-up-write-concern" ).as<std::string>();
+         if( concern == "unjournaled" ) {
+            my->catch_up_concern.journal( false );
+         } else if( concern == "unacknowledged" ) {
+            my->catch_up_concern.acknowledge_level( mongocxx::write_concern::level::k_unacknowledged );
+         } else if( concern != "default" ) {
+            FC_ASSERT( false, "Invalid filter-mongodb-catch-up-write-concern ${c}, expected unjournaled, unacknowledged or default", ("c", concern) );
+         }
+         my->indexes_deferred = my->wipe_database_on_startup && options.count( "filter-mongodb-uri" ) &&
+                                options.at( "filter-mongodb-defer-indexes" ).as<bool>();
          if( options.count( "filter-mongodb-block-start" )) {
             my->start_block_num = options.at( "filter-mongodb-block-start" ).as<uint32_t>();
          }
-         if( my->start_block_num == 0 ) {
-            my->start_block_reached = true;
-         }
-         
+
          if( options.count("filter-contract") ) {
-            my->filter_contract = options.at("filter-contract").as<vector<string> >();
+            for( const auto& rule : options.at("filter-contract").as<vector<string> >() ) {
+               ilog( "filter contract: ${c}", ("c", rule) );
+               my->filter.add_rule( rule );
+            }
+         }
+         my->metrics.set_contracts( my->filter.contracts_named() );
+         for( const auto& n : my->filter.contracts_named() ) {
+            my->registry.track( n );
          }
-         for( auto contractinfo : my->filter_contract ) {
-            ilog( "filter contract: ${c}", ("c", contractinfo) );
+         my->metrics_log_interval = boost::chrono::seconds( options.at( "filter-mongodb-metrics-log-interval" ).as<uint32_t>() );
+         my->stats_interval = boost::chrono::seconds( options.at( "filter-mongodb-stats-interval-sec" ).as<uint32_t>() );
+         if( my->stats_interval.count() > 0 ) {
+            FC_ASSERT( options.count( "filter-mongodb-uri" ), "filter-mongodb-stats-interval-sec requires filter-mongodb-uri" );
+            my->stats.reset( new action_stats( action_stats::parse_dimensions( options.at( "filter-mongodb-stats-dimensions" ).as<std::string>() ),
+                                               options.at( "filter-mongodb-stats-bucket-sec" ).as<uint32_t>(),
+                                               options.at( "filter-mongodb-stats-unique-actors" ).as<bool>() ));
          }
 
-         std::string uri_str = options.at( "filter-mongodb-uri" ).as<std::string>();
-         ilog( "connecting to ${u}", ("u", uri_str));
-         mongocxx::uri uri = mongocxx::uri{uri_str};
-         my->db_name = uri.database();
-         if( my->db_name.empty())
-            my->db_name = "Filter";
-         my->mongo_conn = mongocxx::client{uri};
+         if( sink == "mongo" ) {
+            my->output_sink = filter_mongo_db_plugin_impl::sink_type::mongo;
+         } else if( sink == "file" ) {
+            my->output_sink = filter_mongo_db_plugin_impl::sink_type::file;
+            auto dir = options.at( "filter-mongodb-sink-dir" ).as<boost::filesystem::path>();
+            if( dir.is_relative() )
+               dir = app().data_dir() / dir;
+            ilog( "writing filtered actions to ${d}", ("d", dir.string()) );
+            if( my->wipe_database_on_startup ) {
+               boost::filesystem::remove_all( dir );
+            }
+            my->output_dir = dir;
+            my->output_segment_size = uint64_t( options.at( "filter-mongodb-sink-segment-mb" ).as<uint32_t>() ) * 1024 * 1024;
+            my->output_segment_age = boost::chrono::seconds( options.at( "filter-mongodb-sink-segment-sec" ).as<uint32_t>() );
+         } else if( sink == "null" ) {
+            ilog( "filter-mongodb-sink null: filtered actions are not written anywhere" );
+            my->output_sink = filter_mongo_db_plugin_impl::sink_type::null;
+         } else {
+            FC_ASSERT( false, "Invalid filter-mongodb-sink ${s}, expected mongo, file or null", ("s", sink) );
+         }
+         if( options.count( "filter-mongodb-uri" )) {
+            std::string uri_str = options.at( "filter-mongodb-uri" ).as<std::string>();
+            ilog( "connecting to ${u}", ("u", uri_str));
+            mongocxx::uri uri = mongocxx::uri{uri_str};
+            my->db_name = uri.database();
+            if( my->db_name.empty())
+               my->db_name = "Filter";
+            my->mongo_pool.reset( new mongocxx::pool{uri} );
+            my->mongo_conn = my->mongo_pool->acquire();
+            my->registry.set_write_back( true );
+         }
+         my->checkpoint_enabled = my->mongo_conn && my->output_sink == filter_mongo_db_plugin_impl::sink_type::mongo &&
+                                  options.at( "filter-mongodb-checkpoint" ).as<bool>();
+         if( my->checkpoint_enabled && !my->wipe_database_on_startup ) {
+            // before the writers start, their sinks upsert what may have been written past the checkpoint
+            const bool loaded = my->load_checkpoint();
+            FC_ASSERT( loaded || !resume_replay, "--filter-mongodb-wipe required with --replay-blockchain, --hard-replay-blockchain, or --delete-all-blocks"
+                       " when the mongo database has no checkpoint to resume after." );
+            if( resume_replay ) {
+               ilog( "Replaying into the mongo database, resuming after its checkpoint" );
+            }
+         }
+         if( options.count( "filter-mongodb-spill-dir" ) && my->output_sink != filter_mongo_db_plugin_impl::sink_type::null ) {
+            auto dir = options.at( "filter-mongodb-spill-dir" ).as<boost::filesystem::path>();
+            if( dir.is_relative() )
+               dir = app().data_dir() / dir;
+            if( my->wipe_database_on_startup ) {
+               boost::filesystem::remove_all( dir );
+            }
+            my->spill_dir = dir;
+            my->spill_segment_size = uint64_t( options.at( "filter-mongodb-spill-segment-mb" ).as<uint32_t>() ) * 1024 * 1024;
+         }
+         my->start_writers( std::max( options.at( "filter-mongodb-writer-threads" ).as<uint32_t>(), 1u ));
 
          // hook up to signals on controller
          chain_plugin* chain_plug = app().find_plugin<chain_plugin>();
@@ -615,11 +2202,30 @@ void filter_mongo_db_plugin::plugin_initialize(const variables_map& options)
                chain.accepted_transaction.connect( [&]( const chain::transaction_metadata_ptr& t ) {
                   my->accepted_transaction( t );
                } ));
+         if( my->inline_actions ) {
+            my->applied_transaction_connection.emplace(
+                  chain.applied_transaction.connect( [&]( const chain::transaction_trace_ptr& t ) {
+                     my->applied_transaction( t );
+                  } ));
+         }
+         my->accepted_block_connection.emplace(
+               chain.accepted_block.connect( [&]( const chain::block_state_ptr& bs ) {
+                  my->accepted_block( bs );
+               } ));
+         if( my->irreversible_only ) {
+            my->irreversible_block_connection.emplace(
+                  chain.irreversible_block.connect( [&]( const chain::block_state_ptr& bs ) {
+                     my->irreversible_block( bs );
+                  } ));
+         }
 
-         if( my->wipe_database_on_startup ) {
-            my->wipe_database();
+         if( my->mongo_conn ) {
+            if( my->wipe_database_on_startup ) {
+               my->wipe_database();
+            }
+            my->init();
+            my->load_accounts();
          }
-         my->init();
       } else {
          wlog( "eosio::filter_mongo_db_plugin configured, but no --mongodb-uri specified." );
          wlog( "filter_mongo_db_plugin disabled." );
@@ -632,15 +2238,26 @@ void filter_mongo_db_plugin::plugin_startup()
    if (my->configured) {
       ilog("starting db plugin");
 
+      my->metrics_logged_at = boost::chrono::steady_clock::now();
       my->consume_thread = boost::thread([this] { my->consume_blocks(); });
 
       my->startup = false;
    }
 }
 
+fc::variant filter_mongo_db_plugin::get_metrics()const
+{
+   if( !my || !my->configured )
+      return fc::mutable_variant_object()( "configured", false );
+   return my->get_metrics();
+}
+
 void filter_mongo_db_plugin::plugin_shutdown()
 {
    my->accepted_transaction_connection.reset();
+   my->applied_transaction_connection.reset();
+   my->accepted_block_connection.reset();
+   my->irreversible_block_connection.reset();
 
    my.reset();
 }
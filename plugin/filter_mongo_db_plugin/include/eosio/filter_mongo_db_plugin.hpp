@@ -46,6 +46,9 @@ namespace eosio {
         void plugin_startup();
         void plugin_shutdown();
 
+        /// counters, latency histograms and queue state of the filter pipeline
+        fc::variant get_metrics()const;
+
     private:
         filter_mongo_db_plugin_impl_ptr my;
     };
@@ -0,0 +1,72 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/abi_def.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <fc/time.hpp>
+
+#include <mongocxx/collection.hpp>
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+namespace eosio {
+
+using chain::account_name;
+
+/**
+ * The accounts as the plugin sees them, ahead of the accounts collection.
+ *
+ * The abis of the tracked accounts (the filter contracts and the senders of
+ * captured notifications) are kept in memory: loaded once when tracking starts,
+ * then only changed by setabi, so looking one up never goes to MongoDB.
+ * Changes to any account are collected until flush(), which writes one upsert
+ * keyed by name per changed account; an account created and given several
+ * abis between two flushes is written once, with the last abi.
+ */
+class account_registry {
+public:
+   using abi_ptr = std::shared_ptr<const chain::abi_def>;
+
+   void track( const account_name& n ) { abis.emplace( n.value, abi_ptr() ); }
+   bool tracked( const account_name& n )const { return abis.count( n.value ) > 0; }
+
+   /// the abi of a tracked account, null without a usable one
+   abi_ptr abi( const account_name& n )const;
+
+   /// abi of a tracked account as stored in MongoDB, not written back
+   void load( const account_name& n, abi_ptr abi );
+
+   /// without write back the changes are only applied in memory
+   void set_write_back( bool w ) { write_back = w; }
+
+   void created( const account_name& n, fc::time_point at );
+   /// a null abi could not be unpacked, it is removed from the account
+   void set_abi( const account_name& n, abi_ptr abi, fc::time_point at );
+
+   size_t pending()const { return changes.size(); }
+
+   /// returns false when the write failed; changes MongoDB rejected are dropped, the others kept for the next flush
+   bool flush( mongocxx::collection& accounts );
+
+private:
+   struct change {
+      fc::time_point  created_at; // of the first change, the createdAt of a new document
+      fc::time_point  updated_at;
+      bool            abi_set = false;
+      abi_ptr         abi;
+   };
+
+   change& change_of( const account_name& n, fc::time_point at );
+
+   bool                                   write_back = false;
+   std::unordered_map<uint64_t, abi_ptr>  abis;
+   std::map<uint64_t, change>             changes;
+};
+
+}
@@ -0,0 +1,73 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/filter_mongo_db_plugin/doc_buffer.hpp>
+
+#include <eosio/chain/abi_serializer.hpp>
+#include <eosio/chain/action.hpp>
+#include <eosio/chain/action_receipt.hpp>
+
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/stdx/string_view.hpp>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace eosio {
+
+/**
+ * String forms of names, converted once per name value.
+ *
+ * The same few contracts, actions, actors and permissions come up again and
+ * again, so after the first actions no name is converted or allocated. Past
+ * max_size names the cache starts over; a returned view is valid until the
+ * next call.
+ */
+class name_cache {
+public:
+   explicit name_cache( size_t max_size = 1 << 16 ) : max_size( max_size ) {}
+
+   bsoncxx::stdx::string_view get( uint64_t value );
+
+private:
+   size_t                                   max_size;
+   std::unordered_map<uint64_t, std::string> strings;
+};
+
+/**
+ * Builds the filter collection documents of actions.
+ *
+ * The BSON builder and its buffer are reused from one action to the next and
+ * every document is appended to a doc_buffer, so building a document of a
+ * decoded action allocates nothing beyond the decoding itself once the buffers
+ * have grown. Not thread safe, every decoding thread keeps its own.
+ */
+class action_doc_builder {
+public:
+   using serializer_ptr = std::shared_ptr<const chain::abi_serializer>;
+
+   /// when the undecoded action data is stored, as BSON binary raw_data
+   enum class raw_data_mode {
+      fallback, // only for actions that could not be decoded
+      always,   // next to the decoded data
+      only      // instead of the decoded data, nothing is decoded
+   };
+
+   /// appends the document of act to out, with receiver and global_sequence of the receipt of a traced action
+   void build( const chain::action& act, int32_t action_num, bsoncxx::stdx::string_view trx_id,
+               const serializer_ptr& abis, raw_data_mode raw_data, doc_buffer& out,
+               const chain::action_receipt* receipt = nullptr );
+
+private:
+   void append_header( const chain::action& act, int32_t action_num, bsoncxx::stdx::string_view trx_id,
+                       const chain::action_receipt* receipt );
+
+   name_cache                          names;
+   bsoncxx::builder::basic::document   doc;
+};
+
+}
@@ -0,0 +1,64 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/action.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace eosio {
+
+using chain::account_name;
+using chain::action_name;
+
+/**
+ * Compiled form of the filter-contract option.
+ *
+ * Every rule is one of
+ *   contract                 all actions of the contract
+ *   contract:action          one action of the contract
+ *   contract:action:actor    one action of the contract authorized by actor
+ *
+ * Rules are compiled once into hash tables keyed by the 64-bit name values, so
+ * matching an action never converts a name to a string.
+ */
+class action_filter {
+public:
+   /// parse and add one rule, throws on malformed rules or invalid names
+   void add_rule( const std::string& rule );
+
+   bool empty()const { return contracts.empty(); }
+
+   bool match( const chain::action& act )const { return match( act.account, act ); }
+
+   /// matches the name and actors of act against the rules of contract, e.g. the receiver of a notification
+   bool match( const account_name& contract, const chain::action& act )const;
+
+   /// contracts named by the rules, in the order they were first named
+   const std::vector<account_name>& contracts_named()const { return names; }
+
+   /// position of the contract in contracts_named(), or contracts_named().size() for any other account
+   size_t contract_index( const account_name& contract )const;
+
+private:
+   struct action_rule {
+      bool                         any_actor = false;
+      std::unordered_set<uint64_t> actors;
+   };
+
+   struct contract_rule {
+      size_t                                    index = 0;
+      bool                                      any_action = false;
+      std::unordered_map<uint64_t, action_rule> actions;
+   };
+
+   std::unordered_map<uint64_t, contract_rule> contracts;
+   std::vector<account_name>                   names;
+};
+
+}
@@ -0,0 +1,71 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/filter_mongo_db_plugin/doc_buffer.hpp>
+
+#include <mongocxx/pool.hpp>
+#include <mongocxx/write_concern.hpp>
+
+#include <boost/chrono.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace eosio {
+
+/**
+ * Where the filtered action documents end up.
+ *
+ * Every writer thread owns one sink and hands it the batches of its partition
+ * in order. A sink is only used by that thread.
+ */
+class action_sink {
+public:
+   enum class write_result {
+      written,
+      rejected, // the documents are bad, writing them again would not help
+      retry     // the destination is unavailable, nothing or only part of the batch was stored
+   };
+
+   virtual ~action_sink() = default;
+
+   /// relaxed writes may trade durability for speed until the next sync()
+   virtual write_result write( const doc_buffer& docs, bool relaxed ) = 0;
+
+   /// returns once everything written so far is durable, throws when that cannot be ensured
+   virtual void sync() = 0;
+};
+
+/**
+ * Unordered bulk inserts into db_name.collection over a connection of the pool,
+ * or upserts by trx_id and action_num, always or for the documents with a
+ * block_num up to upsert_until_block (0 none). Relaxed writes use
+ * relaxed_concern; sync() runs fsync on the server.
+ */
+std::unique_ptr<action_sink> make_mongo_sink( mongocxx::pool& pool, const std::string& db_name, const std::string& collection,
+                                              const mongocxx::write_concern& relaxed_concern, bool upsert,
+                                              uint32_t upsert_until_block = 0 );
+
+/**
+ * Appends the documents to segment files in dir, in the format of mongodump: BSON
+ * documents back to back, each starting with its own int32 length.
+ *
+ * The open segment is named actions-<seq>.bson.part and renamed to actions-<seq>.bson
+ * once it holds segment_size bytes or is older than segment_age (0 never), so
+ * everything named *.bson is complete and can be picked up for bulk loading.
+ * A .part file left by a crash is cut back to its last complete document and
+ * renamed when the sink is created. Completed segments are always synced to
+ * disk, the open one only by sync().
+ */
+std::unique_ptr<action_sink> make_file_sink( const boost::filesystem::path& dir, uint64_t segment_size,
+                                             boost::chrono::seconds segment_age );
+
+/// drops the documents, for running the pipeline without any storage
+std::unique_ptr<action_sink> make_null_sink();
+
+}
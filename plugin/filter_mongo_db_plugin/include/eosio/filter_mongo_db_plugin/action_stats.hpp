@@ -0,0 +1,79 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/document/view.hpp>
+
+#include <mongocxx/collection.hpp>
+
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+
+namespace eosio {
+
+/**
+ * Counts of the written actions per time bucket of their block, grouped by any
+ * of account, name and actor, for dashboards to read instead of aggregating
+ * over the filter collection.
+ *
+ * Only the changes since the last flush() are kept: every flush increments the
+ * count of each bucket that changed, so memory stays bounded by the buckets
+ * touched in one interval. Each document keeps the last block counted into it
+ * in block_num and a change only applies to documents behind its first block,
+ * so the blocks written again after a restart are not counted twice; those up
+ * to resume_until are kept apart per block, as they may be partly counted.
+ */
+class action_stats {
+public:
+   enum dimension : uint32_t {
+      account = 1,
+      name    = 2,
+      actor   = 4
+   };
+
+   /// a comma separated list of account, name and actor; throws on anything else
+   static uint32_t parse_dimensions( const std::string& list );
+
+   action_stats( uint32_t dimensions, uint32_t bucket_sec, bool unique_actors );
+
+   /// counts a filter document stamped with its block_num and block_time
+   void add( const bsoncxx::document::view& doc );
+
+   /// blocks up to n may have been counted before the restart
+   void set_resume_until( uint32_t n ) { resume_until = n; }
+
+   bool empty()const { return changes.empty(); }
+
+   /// returns false when the write failed; the changes are dropped when MongoDB rejected one, else kept for the next flush
+   bool flush( mongocxx::collection& stats );
+
+   /// the keys of the upserts, for the index of the stats collection
+   bsoncxx::document::value index_keys()const;
+
+private:
+   // block up to resume_until or all_blocks, bucket start in ms, account, name, actor; unused dimensions stay empty
+   using key = std::tuple<uint32_t, int64_t, std::string, std::string, std::string>;
+   static constexpr uint32_t all_blocks = std::numeric_limits<uint32_t>::max();
+   struct change {
+      uint32_t                first_block = 0;
+      uint32_t                last_block = 0;
+      uint64_t                actions = 0;
+      std::set<std::string>   actors;
+   };
+
+   void add( key&& k, uint32_t block_num, const bsoncxx::document::view& doc );
+
+   uint32_t                 dimensions;
+   int64_t                  bucket_ms;
+   bool                     unique_actors;
+   uint32_t                 resume_until = 0;
+   std::map<key, change>    changes;
+};
+
+}
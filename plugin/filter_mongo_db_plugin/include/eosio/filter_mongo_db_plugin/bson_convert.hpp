@@ -0,0 +1,42 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <fc/variant.hpp>
+#include <fc/variant_object.hpp>
+
+#include <bsoncxx/builder/basic/sub_document.hpp>
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/document/view.hpp>
+
+namespace eosio {
+
+/**
+ * Direct conversion between fc::variant and BSON, without going through a
+ * JSON string in either direction.
+ *
+ * The BSON produced is the same as bsoncxx::from_json( fc::json::to_string( v ))
+ * would produce: integers above 0xffffffff and doubles become strings, other
+ * integers become int32 when they fit and int64 otherwise, blobs become base64
+ * strings. Strings that are not valid UTF-8 throw, like the JSON parser does.
+ */
+void append_variant( bsoncxx::builder::basic::sub_document& doc, const std::string& key, const fc::variant& v );
+
+bsoncxx::document::value to_bson( const fc::variant_object& obj );
+
+/// v must hold an object
+bsoncxx::document::value to_bson( const fc::variant& v );
+
+template<typename T>
+bsoncxx::document::value to_bson( const T& obj ) {
+   fc::variant v;
+   fc::to_variant( obj, v );
+   return to_bson( v );
+}
+
+/// reverse direction, supports the types to_bson produces plus double
+fc::variant from_bson( const bsoncxx::document::view& view );
+
+}
@@ -0,0 +1,99 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <bsoncxx/document/view.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace eosio {
+
+/**
+ * BSON documents stored back to back in one contiguous buffer.
+ *
+ * Every BSON document starts with its own int32 length, so no index is kept;
+ * holding many small documents costs one allocation instead of one per document.
+ */
+class doc_buffer {
+public:
+   /// returns the offset of the document, for at()
+   size_t append( const bsoncxx::document::view& doc ) {
+      const size_t offset = bytes.size();
+      bytes.insert( bytes.end(), doc.data(), doc.data() + doc.length() );
+      ++count;
+      return offset;
+   }
+
+   /// appends doc with the elements of fields added at its end, without building it first
+   size_t append( const bsoncxx::document::view& doc, const bsoncxx::document::view& fields ) {
+      // a document is its int32 length, its elements and a terminating zero
+      const size_t offset = bytes.size();
+      const size_t doc_elements = doc.length() - sizeof(int32_t) - 1;
+      const size_t field_elements = fields.length() - sizeof(int32_t) - 1;
+      const int32_t len = static_cast<int32_t>( doc.length() + field_elements );
+      bytes.resize( offset + len );
+      uint8_t* out = bytes.data() + offset;
+      std::memcpy( out, &len, sizeof(len) );
+      std::memcpy( out + sizeof(len), doc.data() + sizeof(int32_t), doc_elements );
+      std::memcpy( out + sizeof(len) + doc_elements, fields.data() + sizeof(int32_t), field_elements );
+      out[len - 1] = 0;
+      ++count;
+      return offset;
+   }
+
+   void append( const doc_buffer& other ) {
+      bytes.insert( bytes.end(), other.bytes.begin(), other.bytes.end() );
+      count += other.count;
+   }
+
+   /// removes the first n documents
+   void erase_front( size_t n ) {
+      size_t pos = 0;
+      for( size_t i = 0; i < n && pos < bytes.size(); ++i ) {
+         int32_t len;
+         std::memcpy( &len, bytes.data() + pos, sizeof(len) );
+         pos += len;
+      }
+      bytes.erase( bytes.begin(), bytes.begin() + pos );
+      count -= std::min( n, count );
+   }
+
+   template<typename F>
+   void for_each( F&& f )const {
+      size_t pos = 0;
+      while( pos < bytes.size() ) {
+         int32_t len;
+         std::memcpy( &len, bytes.data() + pos, sizeof(len) );
+         f( bsoncxx::document::view( bytes.data() + pos, static_cast<size_t>( len )));
+         pos += len;
+      }
+   }
+
+   bsoncxx::document::view at( size_t offset )const {
+      int32_t len;
+      std::memcpy( &len, bytes.data() + offset, sizeof(len) );
+      return bsoncxx::document::view( bytes.data() + offset, static_cast<size_t>( len ));
+   }
+
+   void clear() {
+      bytes.clear();
+      count = 0;
+   }
+
+   bool empty()const { return count == 0; }
+   size_t size()const { return count; }
+   size_t byte_size()const { return bytes.size(); }
+   /// the documents back to back, byte_size() bytes
+   const uint8_t* data()const { return bytes.data(); }
+
+private:
+   std::vector<uint8_t> bytes;
+   size_t               count = 0;
+};
+
+}
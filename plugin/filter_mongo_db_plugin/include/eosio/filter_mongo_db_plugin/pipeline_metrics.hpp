@@ -0,0 +1,123 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/types.hpp>
+
+#include <fc/variant_object.hpp>
+
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace eosio {
+
+/**
+ * Counters and histograms of the filter pipeline.
+ *
+ * Every thread updates a shard of its own with relaxed single-writer stores, so
+ * recording takes neither a lock nor an atomic read-modify-write. Readers add up
+ * the shards and may see totals that are a few updates behind.
+ */
+class pipeline_metrics {
+public:
+   class counter {
+   public:
+      void add( uint64_t n = 1 ) { value.store( value.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed ); }
+      uint64_t get()const { return value.load( std::memory_order_relaxed ); }
+
+   private:
+      std::atomic<uint64_t> value{0};
+   };
+
+   /// bucket 0 counts zeros, bucket i counts values in [2^(i-1), 2^i)
+   class histogram {
+   public:
+      static constexpr size_t bucket_count = 48;
+
+      void record( uint64_t v ) {
+         size_t b = v == 0 ? 0 : 64 - __builtin_clzll( v );
+         buckets[std::min( b, bucket_count - 1 )].add();
+         count.add();
+         sum.add( v );
+      }
+
+      counter                             count;
+      counter                             sum;
+      std::array<counter, bucket_count>   buckets;
+   };
+
+   struct contract_stats {
+      counter actions;
+      counter decode_ns;
+   };
+
+   struct shard {
+      explicit shard( size_t contract_count ) : contracts( contract_count ) {}
+
+      counter     transactions;
+      counter     fast_path_transactions;
+      counter     duplicate_transactions;
+      counter     actions;
+      counter     decode_errors;
+      counter     abi_hits;
+      counter     abi_misses;
+      counter     bulk_writes;
+      counter     written_docs;
+      counter     rejected_writes; // dropped, not counted in bulk_writes and written_docs
+      counter     rejected_docs;
+      counter     write_errors;   // failed sink writes, retried or rejected
+      counter     mongo_errors;   // failed account bookkeeping
+      histogram   queue_latency_us;   // accepted by the controller to taken by the consume thread
+      histogram   decode_latency_us;  // accepted to every filtered action of the transaction decoded
+      histogram   write_latency_us;   // accepted to written, for the oldest transaction of a bulk write
+      histogram   bulk_write_us;
+      histogram   bulk_write_docs;
+      std::vector<contract_stats> contracts; // per filter contract, the last one counts all others
+   };
+
+   pipeline_metrics();
+
+   pipeline_metrics( const pipeline_metrics& ) = delete;
+   pipeline_metrics& operator=( const pipeline_metrics& ) = delete;
+
+   /// names the per contract stats, call before any thread records
+   void set_contracts( const std::vector<chain::account_name>& names );
+
+   /// the shard of the calling thread
+   shard& local() {
+      static thread_local uint64_t owner = 0;
+      static thread_local shard*   current = nullptr;
+      if( owner != id ) {
+         current = &add_shard();
+         owner = id;
+      }
+      return *current;
+   }
+
+   uint64_t total( counter shard::* c )const;
+   /// upper bound of the bucket holding the q-quantile
+   uint64_t percentile( histogram shard::* h, double q )const;
+
+   fc::mutable_variant_object snapshot()const;
+
+private:
+   shard& add_shard();
+   uint64_t add_up( counter shard::* c )const;
+   std::array<uint64_t, histogram::bucket_count> merged( histogram shard::* h, uint64_t& count, uint64_t& sum )const;
+   fc::variant histogram_variant( histogram shard::* h )const;
+
+   const uint64_t                        id;
+   std::vector<chain::account_name>      contract_names;
+   mutable boost::mutex                  mtx;
+   std::deque<std::unique_ptr<shard>>    shards;
+};
+
+}
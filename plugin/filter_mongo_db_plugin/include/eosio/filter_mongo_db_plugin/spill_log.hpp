@@ -0,0 +1,79 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/filter_mongo_db_plugin/doc_buffer.hpp>
+
+#include <bsoncxx/document/view.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace eosio {
+
+/**
+ * Append-only log of BSON documents kept in memory-mapped segment files.
+ *
+ * Each record is a header with a magic number, the length and a crc32 of the
+ * document, followed by the document. The first record that does not check
+ * out ends the written part of a segment, so a record torn by a crash is
+ * dropped when the log is reopened. Documents are read back in append order;
+ * the acknowledged position is stored next to the segments and a segment file
+ * is removed once everything in it has been acknowledged.
+ *
+ * Not thread safe.
+ */
+class spill_log {
+public:
+   spill_log( const boost::filesystem::path& dir, uint64_t segment_size );
+   ~spill_log();
+
+   spill_log( const spill_log& ) = delete;
+   spill_log& operator=( const spill_log& ) = delete;
+
+   /// true when every appended document has been acknowledged
+   bool empty()const { return ack_pos == write_pos; }
+
+   void append( const bsoncxx::document::view& doc );
+
+   /// starts writing the appended documents back to disk, does not wait for it
+   void sync();
+
+   /// reads up to max_docs documents following the previous read, returns the number read
+   size_t read( doc_buffer& docs, size_t max_docs );
+
+   /// everything read so far has been stored elsewhere and is not returned again
+   void ack();
+
+   /// the next read starts again after the last acknowledged document
+   void rewind() { read_pos = ack_pos; }
+
+private:
+   struct position {
+      uint64_t seq = 0;
+      uint64_t offset = 0;
+
+      bool operator==( const position& o )const { return seq == o.seq && offset == o.offset; }
+   };
+   struct segment;
+
+   boost::filesystem::path segment_path( uint64_t seq )const;
+   segment& open_segment( uint64_t seq, uint64_t create_size = 0 );
+   bool record_at( const segment& s, uint64_t offset, bsoncxx::document::view& doc, uint64_t& next )const;
+   void store_ack();
+
+   boost::filesystem::path                        dir;
+   uint64_t                                       segment_size;
+   position                                       write_pos;
+   position                                       read_pos;
+   position                                       ack_pos;
+   std::map<uint64_t, std::unique_ptr<segment>>   segments;
+};
+
+}
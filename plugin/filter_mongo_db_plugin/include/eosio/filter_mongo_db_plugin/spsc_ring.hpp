@@ -0,0 +1,164 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <boost/chrono.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <vector>
+
+namespace eosio {
+
+/**
+ * Bounded single-producer/single-consumer ring.
+ *
+ * Pushing and popping are lock free. A side that cannot make progress spins
+ * for a short while and then parks on a condition variable; the other side
+ * only takes the mutex when it sees that its peer is parked.
+ */
+template<typename T>
+class spsc_ring {
+public:
+   explicit spsc_ring( size_t min_capacity = 1 ) {
+      size_t cap = 1;
+      while( cap < min_capacity ) cap <<= 1;
+      slots.resize( cap );
+      mask = cap - 1;
+   }
+
+   spsc_ring( const spsc_ring& ) = delete;
+   spsc_ring& operator=( const spsc_ring& ) = delete;
+
+   size_t capacity()const { return slots.size(); }
+   size_t size()const { return tail.load( std::memory_order_acquire ) - head.load( std::memory_order_acquire ); }
+   bool empty()const { return size() == 0; }
+   bool closed()const { return is_closed.load( std::memory_order_acquire ); }
+
+   /// producer side, returns false if the ring is full
+   bool try_push( T&& v ) {
+      const size_t t = tail.load( std::memory_order_relaxed );
+      if( t - head.load( std::memory_order_acquire ) == slots.size() )
+         return false;
+      slots[t & mask] = std::move( v );
+      tail.store( t + 1, std::memory_order_release );
+      notify_consumer();
+      return true;
+   }
+
+   /**
+    * producer side, waits for room; returns false without pushing if the ring
+    * was closed. Time spent waiting is added to blocked.
+    */
+   template<typename Duration>
+   bool push( T&& v, Duration& blocked ) {
+      if( try_push( std::move( v )))
+         return true;
+
+      const auto start = boost::chrono::steady_clock::now();
+      bool pushed = false;
+      for( uint32_t spins = 0; !closed(); ++spins ) {
+         if( try_push( std::move( v ))) {
+            pushed = true;
+            break;
+         }
+         if( spins < spin_limit ) {
+            boost::this_thread::yield();
+            continue;
+         }
+         boost::mutex::scoped_lock lock( mtx );
+         producer_parked.store( true );
+         std::atomic_thread_fence( std::memory_order_seq_cst );
+         while( size() == slots.size() && !closed() ) {
+            not_full.wait( lock );
+         }
+         producer_parked.store( false );
+      }
+      blocked += boost::chrono::duration_cast<Duration>( boost::chrono::steady_clock::now() - start );
+      return pushed;
+   }
+
+   /// consumer side, returns false if the ring is empty
+   bool try_pop( T& v ) {
+      const size_t h = head.load( std::memory_order_relaxed );
+      if( h == tail.load( std::memory_order_acquire ))
+         return false;
+      v = std::move( slots[h & mask] );
+      slots[h & mask] = T();
+      head.store( h + 1, std::memory_order_release );
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      if( producer_parked.load() ) {
+         boost::mutex::scoped_lock lock( mtx );
+         not_full.notify_one();
+      }
+      return true;
+   }
+
+   /**
+    * consumer side, waits until the ring has data, ready() returns true, the
+    * ring is closed or the deadline passes. Returns false on timeout.
+    */
+   template<typename Pred>
+   bool wait_until( const boost::chrono::steady_clock::time_point& deadline, Pred ready ) {
+      for( uint32_t spins = 0; spins < spin_limit; ++spins ) {
+         if( !empty() || ready() || closed() )
+            return true;
+         boost::this_thread::yield();
+      }
+      boost::mutex::scoped_lock lock( mtx );
+      consumer_parked.store( true );
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      bool result = true;
+      while( empty() && !ready() && !closed() ) {
+         if( not_empty.wait_until( lock, deadline ) == boost::cv_status::timeout ) {
+            result = !empty() || ready() || closed();
+            break;
+         }
+      }
+      consumer_parked.store( false );
+      return result;
+   }
+
+   /// wake a parked consumer, used by the producer when it hands over data outside of the ring
+   void notify_consumer() {
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      if( consumer_parked.load() ) {
+         boost::mutex::scoped_lock lock( mtx );
+         not_empty.notify_one();
+      }
+   }
+
+   /// wakes both sides, a closed ring no longer blocks the producer
+   void close() {
+      boost::mutex::scoped_lock lock( mtx );
+      is_closed.store( true );
+      not_empty.notify_all();
+      not_full.notify_all();
+   }
+
+private:
+   static constexpr uint32_t spin_limit = 64;
+
+   std::vector<T>      slots;
+   size_t              mask = 0;
+
+   // producer and consumer indexes on separate cache lines
+   std::atomic<size_t> head{0};
+   char                head_pad[64 - sizeof(std::atomic<size_t>)];
+   std::atomic<size_t> tail{0};
+   char                tail_pad[64 - sizeof(std::atomic<size_t>)];
+
+   std::atomic<bool>   consumer_parked{false};
+   std::atomic<bool>   producer_parked{false};
+   std::atomic<bool>   is_closed{false};
+
+   boost::mutex               mtx;
+   boost::condition_variable  not_empty;
+   boost::condition_variable  not_full;
+};
+
+}
@@ -0,0 +1,74 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/types.hpp>
+
+#include <fc/time.hpp>
+
+#include <functional>
+#include <queue>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace eosio {
+
+/**
+ * Ids of transactions already processed, each kept until its transaction expires.
+ *
+ * An expired transaction cannot be applied again, so its id is of no further use.
+ * The chain time is advanced by the caller from block timestamps; besides, it is
+ * at least the latest expiration seen minus the maximum transaction lifetime.
+ * Past max_size the ids expiring first are forgotten early.
+ */
+class trx_dedup {
+public:
+   trx_dedup( size_t max_size, uint32_t max_lifetime_sec )
+   : max_size( max_size ), max_lifetime_sec( max_lifetime_sec ) {}
+
+   bool enabled()const { return max_size > 0; }
+   size_t size()const { return ids.size(); }
+
+   bool contains( const chain::transaction_id_type& id )const { return ids.count( id ) > 0; }
+
+   /// returns false if the id was already there
+   bool insert( const chain::transaction_id_type& id, fc::time_point_sec expiration ) {
+      if( !enabled() || !ids.insert( id ).second )
+         return false;
+      by_expiration.emplace( expiration.sec_since_epoch(), id );
+      if( expiration.sec_since_epoch() > max_lifetime_sec )
+         advance( fc::time_point_sec( expiration.sec_since_epoch() - max_lifetime_sec ));
+      while( ids.size() > max_size ) {
+         pop();
+      }
+      return true;
+   }
+
+   void erase( const chain::transaction_id_type& id ) { ids.erase( id ); }
+
+   /// forgets the transactions that expired before the chain time t
+   void advance( fc::time_point_sec t ) {
+      while( !by_expiration.empty() && by_expiration.top().first < t.sec_since_epoch() ) {
+         pop();
+      }
+   }
+
+private:
+   void pop() {
+      // an erased id may still have its heap entry, or a newer one after being inserted again
+      ids.erase( by_expiration.top().second );
+      by_expiration.pop();
+   }
+
+   using entry = std::pair<uint32_t, chain::transaction_id_type>;
+
+   size_t                                                                   max_size;
+   uint32_t                                                                 max_lifetime_sec;
+   std::unordered_set<chain::transaction_id_type>                           ids;
+   std::priority_queue<entry, std::vector<entry>, std::greater<entry>>      by_expiration;
+};
+
+}
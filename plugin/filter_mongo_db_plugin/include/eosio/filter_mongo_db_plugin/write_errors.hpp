@@ -0,0 +1,71 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/types.hpp>
+
+#include <mongocxx/exception/bulk_write_exception.hpp>
+
+#include <cstdint>
+
+namespace eosio {
+
+/**
+ * Whether a failed bulk write was refused for the documents themselves, a
+ * document too large, failing validation or with a duplicate key, so writing
+ * them again would fail the same way.
+ *
+ * mongocxx throws bulk_write_exception for every failed execute(), lost
+ * connections, server selection timeouts and write concern errors included.
+ * Only a server reply whose writeErrors all have codes of the documents is a
+ * rejection; anything else is worth retrying once MongoDB is back.
+ */
+inline bool rejected_documents( const mongocxx::bulk_write_exception& e ) {
+   // the errors of a primary stepping down, shutting down or unreachable mid-write
+   const auto transient = []( int32_t code ) {
+      switch( code ) {
+         case 6:     // HostUnreachable
+         case 7:     // HostNotFound
+         case 50:    // MaxTimeMSExpired
+         case 89:    // NetworkTimeout
+         case 91:    // ShutdownInProgress
+         case 189:   // PrimarySteppedDown
+         case 262:   // ExceededTimeLimit
+         case 9001:  // SocketException
+         case 10107: // NotWritablePrimary
+         case 11600: // InterruptedAtShutdown
+         case 11602: // InterruptedDueToReplStateChange
+         case 13435: // NotPrimaryNoSecondaryOk
+         case 13436: // NotPrimaryOrSecondary
+            return true;
+         default:
+            return false;
+      }
+   };
+
+   const auto& reply = e.raw_server_error();
+   if( !reply )
+      return false;
+   const auto view = reply->view();
+   const auto concern_errors = view["writeConcernErrors"];
+   if( concern_errors && concern_errors.type() == bsoncxx::type::k_array && !concern_errors.get_array().value.empty() )
+      return false;
+   const auto errors = view["writeErrors"];
+   if( !errors || errors.type() != bsoncxx::type::k_array )
+      return false;
+   bool rejected = false;
+   for( const auto& error : errors.get_array().value ) {
+      if( error.type() != bsoncxx::type::k_document )
+         return false;
+      const auto code = error.get_document().value["code"];
+      if( !code || code.type() != bsoncxx::type::k_int32 || transient( code.get_int32().value ))
+         return false;
+      rejected = true;
+   }
+   return rejected;
+}
+
+}
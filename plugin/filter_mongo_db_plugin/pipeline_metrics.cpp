@@ -0,0 +1,144 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/filter_mongo_db_plugin/pipeline_metrics.hpp>
+
+#include <fc/variant.hpp>
+
+namespace eosio {
+
+namespace {
+
+   std::atomic<uint64_t> next_metrics_id{1};
+
+   uint64_t bucket_upper_bound( size_t b ) {
+      return b == 0 ? 0 : uint64_t( 1 ) << b;
+   }
+
+   template<typename Buckets>
+   uint64_t quantile( const Buckets& buckets, uint64_t count, double q ) {
+      const uint64_t rank = static_cast<uint64_t>( q * count );
+      uint64_t seen = 0;
+      for( size_t b = 0; b < buckets.size(); ++b ) {
+         seen += buckets[b];
+         if( seen > rank )
+            return bucket_upper_bound( b );
+      }
+      return 0;
+   }
+
+}
+
+pipeline_metrics::pipeline_metrics()
+: id( next_metrics_id++ )
+{
+}
+
+void pipeline_metrics::set_contracts( const std::vector<chain::account_name>& names ) {
+   boost::mutex::scoped_lock lock( mtx );
+   contract_names = names;
+}
+
+pipeline_metrics::shard& pipeline_metrics::add_shard() {
+   boost::mutex::scoped_lock lock( mtx );
+   shards.emplace_back( new shard( contract_names.size() + 1 ));
+   return *shards.back();
+}
+
+uint64_t pipeline_metrics::total( counter shard::* c )const {
+   boost::mutex::scoped_lock lock( mtx );
+   return add_up( c );
+}
+
+uint64_t pipeline_metrics::add_up( counter shard::* c )const {
+   uint64_t result = 0;
+   for( const auto& s : shards ) {
+      result += ((*s).*c).get();
+   }
+   return result;
+}
+
+std::array<uint64_t, pipeline_metrics::histogram::bucket_count>
+pipeline_metrics::merged( histogram shard::* h, uint64_t& count, uint64_t& sum )const {
+   std::array<uint64_t, histogram::bucket_count> result{};
+   count = 0;
+   sum = 0;
+   for( const auto& s : shards ) {
+      const auto& hist = (*s).*h;
+      for( size_t b = 0; b < histogram::bucket_count; ++b ) {
+         result[b] += hist.buckets[b].get();
+      }
+      count += hist.count.get();
+      sum += hist.sum.get();
+   }
+   return result;
+}
+
+uint64_t pipeline_metrics::percentile( histogram shard::* h, double q )const {
+   boost::mutex::scoped_lock lock( mtx );
+   uint64_t count, sum;
+   const auto buckets = merged( h, count, sum );
+   return quantile( buckets, count, q );
+}
+
+fc::variant pipeline_metrics::histogram_variant( histogram shard::* h )const {
+   uint64_t count, sum;
+   const auto buckets = merged( h, count, sum );
+
+   fc::variants non_empty;
+   for( size_t b = 0; b < buckets.size(); ++b ) {
+      if( buckets[b] != 0 )
+         non_empty.emplace_back( fc::variants{ fc::variant( bucket_upper_bound( b )), fc::variant( buckets[b] ) } );
+   }
+
+   return fc::mutable_variant_object()
+         ( "count", count )
+         ( "mean", count == 0 ? 0 : sum / count )
+         ( "p50", quantile( buckets, count, 0.5 ))
+         ( "p90", quantile( buckets, count, 0.9 ))
+         ( "p99", quantile( buckets, count, 0.99 ))
+         ( "buckets", std::move( non_empty ));
+}
+
+fc::mutable_variant_object pipeline_metrics::snapshot()const {
+   boost::mutex::scoped_lock lock( mtx );
+   fc::variants contracts;
+   for( size_t i = 0; i <= contract_names.size(); ++i ) {
+      uint64_t actions = 0, decode_ns = 0;
+      for( const auto& s : shards ) {
+         actions += s->contracts[i].actions.get();
+         decode_ns += s->contracts[i].decode_ns.get();
+      }
+      contracts.emplace_back( fc::mutable_variant_object()
+            ( "contract", i < contract_names.size() ? contract_names[i].to_string() : std::string( "*" ))
+            ( "actions", actions )
+            ( "decode_ns", decode_ns ));
+   }
+
+   return fc::mutable_variant_object()
+         ( "transactions", add_up( &shard::transactions ))
+         ( "fast_path_transactions", add_up( &shard::fast_path_transactions ))
+         ( "duplicate_transactions", add_up( &shard::duplicate_transactions ))
+         ( "actions", add_up( &shard::actions ))
+         ( "decode_errors", add_up( &shard::decode_errors ))
+         ( "abi_cache", fc::mutable_variant_object()
+               ( "hits", add_up( &shard::abi_hits ))
+               ( "misses", add_up( &shard::abi_misses )))
+         ( "bulk_writes", fc::mutable_variant_object()
+               ( "count", add_up( &shard::bulk_writes ))
+               ( "documents", add_up( &shard::written_docs ))
+               ( "rejected", add_up( &shard::rejected_writes ))
+               ( "rejected_documents", add_up( &shard::rejected_docs ))
+               ( "write_errors", add_up( &shard::write_errors ))
+               ( "mongo_errors", add_up( &shard::mongo_errors ))
+               ( "duration_us", histogram_variant( &shard::bulk_write_us ))
+               ( "size", histogram_variant( &shard::bulk_write_docs )))
+         ( "latency_us", fc::mutable_variant_object()
+               ( "queue", histogram_variant( &shard::queue_latency_us ))
+               ( "decode", histogram_variant( &shard::decode_latency_us ))
+               ( "write", histogram_variant( &shard::write_latency_us )))
+         ( "contracts", std::move( contracts ));
+}
+
+}
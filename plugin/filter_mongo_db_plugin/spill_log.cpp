@@ -0,0 +1,255 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/filter_mongo_db_plugin/spill_log.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace eosio {
+
+namespace {
+
+   const uint32_t record_magic = 0x4c495053; // "SPIL"
+   const char*    ack_file     = "ack";
+
+   struct record_header {
+      uint32_t magic;
+      uint32_t length;
+      uint32_t crc;
+      uint32_t reserved;
+   };
+
+   uint64_t record_size( uint64_t length ) {
+      return ( sizeof(record_header) + length + 7 ) & ~uint64_t( 7 );
+   }
+
+   uint32_t checksum( const void* data, size_t length ) {
+      boost::crc_32_type crc;
+      crc.process_bytes( data, length );
+      return crc.checksum();
+   }
+
+   bool parse_segment_name( const std::string& name, uint64_t& seq ) {
+      if( name.size() != 26 || name.compare( 0, 6, "spill-" ) != 0 || name.compare( 22, 4, ".log" ) != 0 )
+         return false;
+      const auto hex = name.substr( 6, 16 );
+      if( hex.find_first_not_of( "0123456789abcdef" ) != std::string::npos )
+         return false;
+      seq = std::stoull( hex, nullptr, 16 );
+      return true;
+   }
+
+}
+
+struct spill_log::segment {
+   explicit segment( const boost::filesystem::path& p )
+   : file( p.string().c_str(), boost::interprocess::read_write )
+   , region( file, boost::interprocess::read_write ) {}
+
+   char* data()const { return static_cast<char*>( region.get_address() ); }
+   uint64_t size()const { return region.get_size(); }
+
+   boost::interprocess::file_mapping   file;
+   boost::interprocess::mapped_region  region;
+};
+
+spill_log::spill_log( const boost::filesystem::path& dir, uint64_t segment_size )
+: dir( dir )
+, segment_size( std::max<uint64_t>( segment_size, 1 << 16 ))
+{
+   boost::filesystem::create_directories( dir );
+
+   std::vector<uint64_t> seqs;
+   for( boost::filesystem::directory_iterator it( dir ), end; it != end; ++it ) {
+      uint64_t seq;
+      if( parse_segment_name( it->path().filename().string(), seq ))
+         seqs.push_back( seq );
+   }
+   std::sort( seqs.begin(), seqs.end() );
+
+   bool have_ack = false;
+   {
+      std::ifstream in( ( dir / ack_file ).string(), std::ios::binary );
+      uint64_t v[2];
+      if( in.read( reinterpret_cast<char*>( v ), sizeof(v) ) && in.gcount() == sizeof(v) ) {
+         ack_pos = { v[0], v[1] };
+         have_ack = true;
+      }
+   }
+
+   // segments before the acknowledged one have been written completely
+   while( !seqs.empty() && have_ack && seqs.front() < ack_pos.seq ) {
+      boost::filesystem::remove( segment_path( seqs.front() ));
+      seqs.erase( seqs.begin() );
+   }
+
+   if( seqs.empty() ) {
+      ack_pos = { have_ack ? ack_pos.seq + 1 : 0, 0 };
+      write_pos = ack_pos;
+   } else {
+      if( !have_ack || ack_pos.seq < seqs.front() ) {
+         ack_pos = { seqs.front(), 0 };
+      }
+      // the written part of the last segment ends at the first record that does not check out
+      const uint64_t last = seqs.back();
+      const auto& s = open_segment( last );
+      uint64_t offset = ack_pos.seq == last ? ack_pos.offset : 0;
+      bsoncxx::document::view doc;
+      uint64_t next;
+      while( record_at( s, offset, doc, next )) {
+         offset = next;
+      }
+      write_pos = { last, offset };
+   }
+   read_pos = ack_pos;
+
+   if( !empty() ) {
+      ilog( "spill log ${d} has ${n} segments to replay", ("d", dir.string())("n", seqs.size()) );
+   }
+}
+
+spill_log::~spill_log() {
+   auto it = segments.find( write_pos.seq );
+   if( it != segments.end() ) {
+      it->second->region.flush( 0, 0, false );
+   }
+}
+
+boost::filesystem::path spill_log::segment_path( uint64_t seq )const {
+   char name[32];
+   std::snprintf( name, sizeof(name), "spill-%016llx.log", static_cast<unsigned long long>( seq ));
+   return dir / name;
+}
+
+spill_log::segment& spill_log::open_segment( uint64_t seq, uint64_t create_size ) {
+   auto it = segments.find( seq );
+   if( it != segments.end() )
+      return *it->second;
+
+   const auto path = segment_path( seq );
+   if( create_size > 0 ) {
+      // write the zeros out instead of leaving a sparse file, a full disk then fails here and not in a mapped write
+      std::ofstream out( path.string(), std::ios::binary | std::ios::trunc );
+      const std::vector<char> zeros( 1 << 16 );
+      for( uint64_t written = 0; written < create_size && out; written += zeros.size() ) {
+         out.write( zeros.data(), std::min<uint64_t>( zeros.size(), create_size - written ));
+      }
+      out.flush();
+      FC_ASSERT( out.good(), "Unable to create spill log segment ${f}", ("f", path.string()) );
+   }
+   auto& s = segments[seq];
+   s.reset( new segment( path ));
+   return *s;
+}
+
+bool spill_log::record_at( const segment& s, uint64_t offset, bsoncxx::document::view& doc, uint64_t& next )const {
+   if( offset + sizeof(record_header) > s.size() )
+      return false;
+
+   const char* p = s.data() + offset;
+   record_header h;
+   std::memcpy( &h, p, sizeof(h) );
+   if( h.magic != record_magic || h.length < 5 || offset + record_size( h.length ) > s.size() )
+      return false;
+
+   const char* body = p + sizeof(h);
+   int32_t bson_length;
+   std::memcpy( &bson_length, body, sizeof(bson_length) );
+   if( static_cast<uint32_t>( bson_length ) != h.length || checksum( body, h.length ) != h.crc )
+      return false;
+
+   doc = bsoncxx::document::view( reinterpret_cast<const uint8_t*>( body ), h.length );
+   next = offset + record_size( h.length );
+   return true;
+}
+
+void spill_log::append( const bsoncxx::document::view& doc ) {
+   const uint64_t need = record_size( doc.length() );
+
+   auto it = segments.find( write_pos.seq );
+   if( it == segments.end() || write_pos.offset + need > it->second->size() ) {
+      if( it != segments.end() ) {
+         it->second->region.flush( 0, 0, true );
+         write_pos = { write_pos.seq + 1, 0 };
+      }
+      open_segment( write_pos.seq, std::max( segment_size, need ));
+      it = segments.find( write_pos.seq );
+   }
+
+   char* p = it->second->data() + write_pos.offset;
+   const record_header h{ record_magic, static_cast<uint32_t>( doc.length() ), checksum( doc.data(), doc.length() ), 0 };
+   std::memcpy( p + sizeof(h), doc.data(), doc.length() );
+   std::memcpy( p, &h, sizeof(h) );
+   write_pos.offset += need;
+}
+
+void spill_log::sync() {
+   auto it = segments.find( write_pos.seq );
+   if( it != segments.end() ) {
+      it->second->region.flush( 0, 0, true );
+   }
+}
+
+size_t spill_log::read( doc_buffer& docs, size_t max_docs ) {
+   size_t n = 0;
+   while( n < max_docs && !( read_pos == write_pos )) {
+      if( !segments.count( read_pos.seq ) && !boost::filesystem::exists( segment_path( read_pos.seq ))) {
+         elog( "spill log segment ${f} is missing, skipping it", ("f", segment_path( read_pos.seq ).string()) );
+         read_pos = { read_pos.seq + 1, 0 };
+         continue;
+      }
+
+      const auto& s = open_segment( read_pos.seq );
+      bsoncxx::document::view doc;
+      uint64_t next;
+      if( record_at( s, read_pos.offset, doc, next )) {
+         docs.append( doc );
+         read_pos.offset = next;
+         ++n;
+      } else if( read_pos.seq < write_pos.seq ) {
+         read_pos = { read_pos.seq + 1, 0 };
+      } else {
+         elog( "Corrupt record in spill log ${f} at ${o}, skipping the rest of the segment",
+               ("f", segment_path( read_pos.seq ).string())("o", read_pos.offset) );
+         read_pos = write_pos;
+      }
+   }
+   return n;
+}
+
+void spill_log::ack() {
+   ack_pos = read_pos;
+   store_ack();
+
+   for( auto it = segments.begin(); it != segments.end() && it->first < ack_pos.seq; ) {
+      const auto path = segment_path( it->first );
+      it = segments.erase( it );
+      boost::filesystem::remove( path );
+   }
+}
+
+void spill_log::store_ack() {
+   const auto tmp = dir / "ack.tmp";
+   {
+      std::ofstream out( tmp.string(), std::ios::binary | std::ios::trunc );
+      const uint64_t v[2] = { ack_pos.seq, ack_pos.offset };
+      out.write( reinterpret_cast<const char*>( v ), sizeof(v) );
+      out.flush();
+      FC_ASSERT( out.good(), "Unable to write ${f}", ("f", tmp.string()) );
+   }
+   boost::filesystem::rename( tmp, dir / ack_file );
+}
+
+}